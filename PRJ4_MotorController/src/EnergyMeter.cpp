@@ -0,0 +1,178 @@
+#include "EnergyMeter.h"
+
+static const char* NVS_NAMESPACE = "energy";
+static const char* NVS_KEY_TOTAL = "total";
+
+// INA219 registers
+static const uint8_t REG_CONFIG = 0x00;
+static const uint8_t REG_SHUNT = 0x01;
+static const uint8_t REG_BUS = 0x02;
+
+// 32 V bus range, +-320 mV shunt range (as Adafruit's 32V_2A setup),
+// 9 bit bus ADC (84 us), 12 bit single shunt sample (532 us), shunt and
+// bus triggered. Writing the register starts a conversion.
+static const uint16_t CONFIG_TRIGGERED = 0x2000 | 0x1800 | (0x0 << 7) | (0x3 << 3) | 0x3;
+static const uint16_t BUS_CONVERSION_READY = 0x0002;
+static const uint32_t CONVERSION_US = 620;
+
+// Idle samples come 100 ms apart; a longer gap is not integrated
+static const uint32_t MAX_SAMPLE_GAP_US = 200000;
+
+// The total goes to NVS after this long or once this much is unsaved
+static const uint32_t SAVE_INTERVAL_MS = 60UL * 60UL * 1000UL;
+static const uint64_t SAVE_ENERGY_mJ = 100000;
+
+// Seizing: mean current this much above the usual for its direction...
+static const float SEIZING_RATIO = 1.25f;
+// ...on this many moves in a row. Shorter moves are not judged.
+static const int SEIZING_MOVES = 3;
+static const uint16_t MIN_JUDGED_SAMPLES = 10;
+
+EnergyMeter::EnergyMeter(uint8_t address, float shuntOhm)
+    : _wire(NULL), _address(address), _shuntOhm(shuntOhm), _mutex(NULL), _lastSampleUs(0),
+      _pendingEnergy_mJ(0.0f), _total_mJ(0), _saved_mJ(0), _savedMs(0), _moving(false), _moveStartUs(0),
+      _currentSum_mA(0.0f), _historyNext(0), _historyCount(0), _heavyMoves(0) {
+    _baseline_mA[0] = _baseline_mA[1] = 0.0f;
+}
+
+bool EnergyMeter::begin(TwoWire& wire) {
+    _wire = &wire;
+    _wire->setClock(400000);
+    if (_mutex == NULL) _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+
+    _prefs.begin(NVS_NAMESPACE, false);
+    _total_mJ = _saved_mJ = _prefs.getULong64(NVS_KEY_TOTAL, 0);
+    _savedMs = millis();
+    return writeRegister(REG_CONFIG, CONFIG_TRIGGERED);
+}
+
+bool EnergyMeter::writeRegister(uint8_t reg, uint16_t value) {
+    _wire->beginTransmission(_address);
+    _wire->write(reg);
+    _wire->write((uint8_t)(value >> 8));
+    _wire->write((uint8_t)(value & 0xFF));
+    return _wire->endTransmission() == 0;
+}
+
+bool EnergyMeter::readRegister(uint8_t reg, uint16_t& value) {
+    _wire->beginTransmission(_address);
+    _wire->write(reg);
+    if (_wire->endTransmission(false) != 0) return false;
+    if (_wire->requestFrom(_address, (uint8_t)2) != 2) return false;
+    value = (uint16_t)(_wire->read() << 8);
+    value |= (uint16_t)_wire->read();
+    return true;
+}
+
+bool EnergyMeter::sample(float& current_mA, float& busVoltage_V) {
+    // A second trigger mid-conversion would restart it and mix up the reads
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint16_t bus, shunt;
+    bool ok = writeRegister(REG_CONFIG, CONFIG_TRIGGERED);
+    if (ok) delayMicroseconds(CONVERSION_US);
+    for (int tries = 0; ok; ++tries) {
+        ok = readRegister(REG_BUS, bus);
+        if (!ok || (bus & BUS_CONVERSION_READY)) break;
+        if (tries >= 5) ok = false;
+        else delayMicroseconds(50);
+    }
+    ok = ok && readRegister(REG_SHUNT, shunt);
+    xSemaphoreGive(_mutex);
+    if (!ok) return false;
+
+    // Shunt LSB is 10 uV, bus LSB 4 mV in bits 15..3
+    current_mA = (int16_t)shunt * 0.01f / _shuntOhm;
+    busVoltage_V = (bus >> 3) * 0.004f;
+    return true;
+}
+
+void EnergyMeter::addSample(uint32_t nowUs, float current_mA, float busVoltage_V) {
+    uint32_t dtUs = nowUs - _lastSampleUs;
+    _lastSampleUs = nowUs;
+    float energy_mJ = (dtUs <= MAX_SAMPLE_GAP_US) ? busVoltage_V * current_mA * dtUs / 1e6f : 0.0f;
+    if (energy_mJ > 0.0f) _pendingEnergy_mJ += energy_mJ;
+
+    if (!_moving) return;
+    _current.samples++;
+    _currentSum_mA += current_mA;
+    if (current_mA > _current.peak_mA) _current.peak_mA = current_mA;
+    if (energy_mJ > 0.0f) _current.energy_mJ += energy_mJ;
+}
+
+void EnergyMeter::startMove(uint32_t nowUs, bool closing) {
+    _current = MoveProfile();
+    _current.closing = closing;
+    _currentSum_mA = 0.0f;
+    _moveStartUs = nowUs;
+    _moving = true;
+}
+
+const MoveProfile& EnergyMeter::finishMove(uint32_t nowUs, int axes) {
+    _moving = false;
+    _current.axes = (uint8_t)axes;
+    _current.durationMs = (nowUs - _moveStartUs) / 1000;
+    if (_current.samples > 0) _current.mean_mA = _currentSum_mA / _current.samples;
+
+    _history[_historyNext] = _current;
+    _historyNext = (_historyNext + 1) % HISTORY;
+    if (_historyCount < HISTORY) _historyCount++;
+
+    checkSeizing(_current);
+
+    // Whole millijoules only, the remainder carries over to the next move
+    uint32_t whole = (uint32_t)_pendingEnergy_mJ;
+    _pendingEnergy_mJ -= whole;
+    xSemaphoreTake(_mutex, portMAX_DELAY);  // A 64 bit store isn't atomic, see totalEnergy_mJ()
+    _total_mJ += whole;
+    xSemaphoreGive(_mutex);
+    uint64_t unsaved = _total_mJ - _saved_mJ;
+    if (unsaved >= SAVE_ENERGY_mJ || (unsaved > 0 && millis() - _savedMs >= SAVE_INTERVAL_MS)) saveTotal();
+    return lastMove();
+}
+
+void EnergyMeter::saveTotal() {
+    _prefs.putULong64(NVS_KEY_TOTAL, _total_mJ);
+    _saved_mJ = _total_mJ;
+    _savedMs = millis();
+}
+
+void EnergyMeter::checkSeizing(const MoveProfile& move) {
+    if (move.samples < MIN_JUDGED_SAMPLES || move.axes > 1) return;
+
+    float& baseline = _baseline_mA[move.closing ? 1 : 0];
+    if (baseline > 0.0f && move.mean_mA > baseline * SEIZING_RATIO) {
+        _heavyMoves++;
+        return;  // Don't let a seizing valve become the new normal
+    }
+    _heavyMoves = 0;
+    baseline = (baseline > 0.0f) ? baseline + 0.2f * (move.mean_mA - baseline) : move.mean_mA;
+}
+
+const MoveProfile& EnergyMeter::lastMove() const {
+    return _history[(_historyNext + HISTORY - 1) % HISTORY];
+}
+
+bool EnergyMeter::isSeizing() const {
+    return _heavyMoves >= SEIZING_MOVES;
+}
+
+uint64_t EnergyMeter::totalEnergy_mJ() const {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint64_t total = _total_mJ;
+    xSemaphoreGive(_mutex);
+    return total;
+}
+
+void EnergyMeter::printHistory(Print& out) const {
+    char line[80];
+    out.println("Dir    ms  samples  peak mA  mean mA       mJ  axes");
+    for (int i = 0; i < _historyCount; ++i) {
+        const MoveProfile& m = _history[(_historyNext + HISTORY - _historyCount + i) % HISTORY];
+        snprintf(line, sizeof(line), "%-5s %5u %8u %8.0f %8.0f %8.1f %5u", m.closing ? "close" : "open",
+                 (unsigned)m.durationMs, (unsigned)m.samples, m.peak_mA, m.mean_mA, m.energy_mJ, (unsigned)m.axes);
+        out.println(line);
+    }
+    snprintf(line, sizeof(line), "Total %.3f J, baseline open %.0f mA / close %.0f mA%s",
+             totalEnergy_mJ() / 1000.0, _baseline_mA[0], _baseline_mA[1], isSeizing() ? ", SEIZING" : "");
+    out.println(line);
+}
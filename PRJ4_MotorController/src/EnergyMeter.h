@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Preferences.h>
+
+// Summary of one valve move, built from the high-rate samples taken while
+// the motor runs
+struct MoveProfile {
+    uint32_t durationMs = 0;
+    uint16_t samples = 0;
+    bool closing = false;   // Towards the valve seat
+    uint8_t axes = 1;       // Valves moving at the same time, see finishMove()
+    float peak_mA = 0.0f;
+    float mean_mA = 0.0f;
+    float energy_mJ = 0.0f;
+};
+
+// Motor supply metering on the INA219. Conversions are triggered one at a
+// time with a single 12 bit shunt sample and a 9 bit bus sample (~0.6 ms),
+// so the monitor task can sample every few ms while the motor runs and
+// idle otherwise. Energy is integrated per move and in total; the total is
+// saved to NVS hourly or after a sizeable change, so a reboot loses at most
+// that much instead of the flash taking a write per move. A move that needs
+// clearly more current than usual in the same direction, several times in a
+// row, flags a seizing valve long before it stalls.
+class EnergyMeter {
+public:
+    static constexpr int HISTORY = 16;  // Last moves kept for the ENERGY command
+
+    EnergyMeter(uint8_t address = 0x40, float shuntOhm = 0.1f);
+
+    // Call after Adafruit_INA219::begin(), which loads the calibration
+    bool begin(TwoWire& wire = Wire);
+
+    // One triggered conversion; false when the INA219 doesn't answer.
+    // From any task, the monitor samples while calibration probes the insert.
+    bool sample(float& current_mA, float& busVoltage_V);
+
+    // Feed every sample; moving selects what ends up in the move profile
+    void addSample(uint32_t nowUs, float current_mA, float busVoltage_V);
+    void startMove(uint32_t nowUs, bool closing);
+    // axes is the most valves that moved at once. The INA219 sees the shared
+    // supply, so only single-valve moves count for seizing detection.
+    const MoveProfile& finishMove(uint32_t nowUs, int axes = 1);
+
+    const MoveProfile& lastMove() const;
+    bool isSeizing() const;
+    uint64_t totalEnergy_mJ() const;  // From any task
+
+    void printHistory(Print& out) const;
+
+private:
+    bool writeRegister(uint8_t reg, uint16_t value);
+    bool readRegister(uint8_t reg, uint16_t& value);
+    void checkSeizing(const MoveProfile& move);
+    void saveTotal();
+
+    TwoWire* _wire;
+    uint8_t _address;
+    float _shuntOhm;
+    SemaphoreHandle_t _mutex;  // One conversion at a time; also guards _total_mJ
+    StaticSemaphore_t _mutexBuffer;
+
+    uint32_t _lastSampleUs;
+    float _pendingEnergy_mJ;  // Not yet added to _total_mJ
+    uint64_t _total_mJ;
+    uint64_t _saved_mJ;       // Total as last written to NVS
+    uint32_t _savedMs;
+    Preferences _prefs;       // Kept open, opening NVS allocates
+
+    bool _moving;
+    uint32_t _moveStartUs;
+    float _currentSum_mA;
+    MoveProfile _current;
+
+    MoveProfile _history[HISTORY];  // Ring buffer, newest at _historyNext - 1
+    int _historyNext;
+    int _historyCount;
+
+    float _baseline_mA[2];  // Typical mean current per direction (0 = opening)
+    int _heavyMoves;
+};
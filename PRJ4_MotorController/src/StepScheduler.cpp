@@ -0,0 +1,53 @@
+#include "StepScheduler.h"
+
+StepScheduler::StepScheduler(uint32_t periodUs, uint32_t slotUs)
+    : _periodUs(periodUs), _slotUs(slotUs), _active(0) {
+    for (int i = 0; i < MAX_AXES; ++i) _nextUs[i] = 0;
+}
+
+// Slots are taken from a grid that starts at micros() == 0, so axes
+// started at different times still keep their distance
+void StepScheduler::start(int axis, uint32_t nowUs) {
+    uint32_t slot = ((uint32_t)axis * _slotUs) % _periodUs;
+    uint32_t phase = nowUs % _periodUs;
+    uint32_t wait = (slot + _periodUs - phase) % _periodUs;
+    _nextUs[axis] = nowUs + wait;
+    _active |= (uint8_t)(1 << axis);
+}
+
+void StepScheduler::stop(int axis) {
+    _active &= (uint8_t)~(1 << axis);
+}
+
+bool StepScheduler::isActive(int axis) const {
+    return _active & (1 << axis);
+}
+
+bool StepScheduler::anyActive() const {
+    return _active != 0;
+}
+
+uint8_t StepScheduler::due(uint32_t nowUs) {
+    uint8_t mask = 0;
+    for (int i = 0; i < MAX_AXES; ++i) {
+        if (!(_active & (1 << i)) || (int32_t)(nowUs - _nextUs[i]) < 0) continue;
+        mask |= (uint8_t)(1 << i);
+        _nextUs[i] += _periodUs;
+        if ((int32_t)(nowUs - _nextUs[i]) >= 0) {
+            // Late by more than a period: back onto the slot grid
+            _nextUs[i] += ((nowUs - _nextUs[i]) / _periodUs + 1) * _periodUs;
+        }
+    }
+    return mask;
+}
+
+uint32_t StepScheduler::untilNext(uint32_t nowUs) const {
+    uint32_t wait = _periodUs;
+    for (int i = 0; i < MAX_AXES; ++i) {
+        if (!(_active & (1 << i))) continue;
+        int32_t left = (int32_t)(_nextUs[i] - nowUs);
+        if (left <= 0) return 0;
+        if ((uint32_t)left < wait) wait = left;
+    }
+    return wait;
+}
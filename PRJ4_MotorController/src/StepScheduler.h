@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// Merges the step pulse trains of up to MAX_AXES drives into one timeline
+// for the motor task. All axes step at the same period, but each owns a
+// fixed slot within it (axis * slotUs), so two pulses never coincide and the
+// supply sees the coil current steps spread out. Keeping the slots close
+// leaves the rest of the period free for other tasks.
+class StepScheduler {
+public:
+    static constexpr int MAX_AXES = 4;
+
+    StepScheduler(uint32_t periodUs, uint32_t slotUs);
+
+    // Starts stepping an axis at its next slot, stop() ends it
+    void start(int axis, uint32_t nowUs);
+    void stop(int axis);
+    bool isActive(int axis) const;
+    bool anyActive() const;
+
+    // Bit mask of the axes due at nowUs; each of them moves on one period.
+    // An axis that fell more than a period behind skips the missed steps.
+    uint8_t due(uint32_t nowUs);
+
+    // Microseconds until the next active axis is due, 0 if one is due now
+    uint32_t untilNext(uint32_t nowUs) const;
+
+private:
+    uint32_t _periodUs;
+    uint32_t _slotUs;
+    uint32_t _nextUs[MAX_AXES];
+    uint8_t _active;  // Bit per axis
+};
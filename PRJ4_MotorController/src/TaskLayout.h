@@ -0,0 +1,23 @@
+#pragma once
+
+#include "TaskCreate.h"  // CREATE_TASK
+
+// Core and priority plan. Core 1 runs the timing-critical work (step
+// generation, stall monitor) above everything else; core 0 takes the radio
+// and the slow control loop. Arduino's loop() stays on core 1 at priority 1.
+#define CORE_REALTIME   1
+#define CORE_RADIO      0
+
+// Priorities, higher preempts lower on the same core
+#define PRIO_MOTOR      5
+#define PRIO_MONITOR    4
+#define PRIO_LORA       2
+#define PRIO_LOCAL_CTRL 1
+
+// Stack sizes in bytes. Not yet measured on a board: run esp32dev-static
+// through a calibration and radio traffic, then replace these with the
+// defines the MEM report ends with.
+#define STACK_MOTOR      2048
+#define STACK_MONITOR    4096  // Float printf and the NVS energy total
+#define STACK_LORA       2048
+#define STACK_LOCAL_CTRL 2048
@@ -0,0 +1,10 @@
+#include "ValveAxis.h"
+
+// Axis 0 keeps the namespace of the single-valve firmware
+static const char* const NVS_NAMESPACES[] = {"valve", "valve1", "valve2", "valve3"};
+
+ValveAxis::ValveAxis(uint8_t index, uint8_t stepPin, uint8_t dirPin, Stream* uart, float rSense)
+    : index(index), stepPin(stepPin), dirPin(dirPin), driver(uart, rSense, index),
+      characteristic(NVS_NAMESPACES[index & 0x03]), position(0), target(0), commandedPercent(0.0f),
+      commandReceived(false), stallDetected(false), moving(false), statusPending(false), peakCurrent_mA(0.0f),
+      lastStepDirection(-1), heldTarget(-1), takeUpSteps(0), stallGuardPolls(0), stallGuardLow(0) {}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TMCStepper.h>
+#include "ValveCharacteristic.h"
+
+// One valve drive: a TMC2209 on the shared UART (its address, set with
+// MS1/MS2, is also the axis index), its STEP/DIR pins, the learned curve
+// and the motion state. Targets are set from the radio and local control
+// tasks; the motion fields belong to the motor task, the StallGuard fields
+// to the monitor task.
+struct ValveAxis {
+    ValveAxis(uint8_t index, uint8_t stepPin, uint8_t dirPin, Stream* uart, float rSense);
+
+    const uint8_t index;
+    const uint8_t stepPin;
+    const uint8_t dirPin;
+    TMC2209Stepper driver;
+    ValveCharacteristic characteristic;
+
+    volatile int position;            // Steps, 0 = retracted, MAX_POSITION = fully pressed
+    volatile int target;
+    volatile float commandedPercent;  // Last flow percent asked for
+    volatile bool commandReceived;
+    volatile bool stallDetected;
+    volatile bool moving;             // For the duration of a move
+    volatile bool statusPending;      // STAT frame owed to the remote
+    volatile float peakCurrent_mA;    // Motor supply peak while this axis moved
+
+    // Motor task
+    int lastStepDirection;  // HIGH closing, LOW opening, -1 unknown
+    int heldTarget;         // Small reversal waiting for a bigger command
+    int takeUpSteps;        // Play left to take up before the pin moves
+
+    // Monitor task
+    int stallGuardPolls;    // Since the move started
+    int stallGuardLow;      // Consecutive polls under the threshold
+};
@@ -0,0 +1,114 @@
+#include "ValveCharacteristic.h"
+#include <Preferences.h>
+
+static const char* NVS_KEY_CURVE = "curve";
+static const char* NVS_KEY_BACKLASH = "backlash";
+static const char* NVS_KEY_SATURATION = "saturation";
+
+ValveCharacteristic::ValveCharacteristic(const char* nvsNamespace) : _backlashSteps(0), _nvsNamespace(nvsNamespace) {
+    reset();
+}
+
+void ValveCharacteristic::reset() {
+    for (int i = 0; i < POINTS; ++i) {
+        _points[i] = i * 100 / (POINTS - 1);
+    }
+    _saturation = 100;
+    _calibrated = false;
+}
+
+bool ValveCharacteristic::isCalibrated() const {
+    return _calibrated;
+}
+
+int ValveCharacteristic::saturationOpening() const {
+    return _saturation;
+}
+
+int ValveCharacteristic::backlashSteps() const {
+    return _backlashSteps;
+}
+
+void ValveCharacteristic::setBacklashSteps(int steps) {
+    _backlashSteps = (steps < 0) ? 0 : (steps > 255 ? 255 : steps);
+}
+
+float ValveCharacteristic::flowToOpening(float flowPercent) const {
+    if (flowPercent <= 0.0f) return _points[0];
+    if (flowPercent >= 100.0f) return _points[POINTS - 1];
+
+    float scaled = flowPercent * (POINTS - 1) / 100.0f;
+    int i = (int)scaled;
+    float frac = scaled - i;
+    float upper = (i + 1 == POINTS - 1) ? _saturation : _points[i + 1];
+    return _points[i] + frac * (upper - _points[i]);
+}
+
+float ValveCharacteristic::openingToFlow(float openingPercent) const {
+    if (openingPercent <= _points[0]) return 0.0f;
+    if (openingPercent >= _saturation) return 100.0f;
+
+    for (int i = 1; i < POINTS; ++i) {
+        float upper = (i == POINTS - 1) ? _saturation : _points[i];
+        if (openingPercent <= upper) {
+            float span = upper - _points[i - 1];
+            float frac = (span > 0.0f) ? (openingPercent - _points[i - 1]) / span : 0.0f;
+            return (i - 1 + frac) * 100.0f / (POINTS - 1);
+        }
+    }
+    return 100.0f;
+}
+
+bool ValveCharacteristic::setPoints(const uint8_t* points, int count) {
+    if (count != POINTS) return false;
+    if (points[0] != 0 || points[POINTS - 1] != 100) return false;
+    for (int i = 1; i < POINTS; ++i) {
+        if (points[i] < points[i - 1]) return false;
+    }
+
+    for (int i = 0; i < POINTS; ++i) _points[i] = points[i];
+    _saturation = 100;
+    _calibrated = true;
+    return true;
+}
+
+void ValveCharacteristic::buildFromContactPoint(int contactOpening) {
+    if (contactOpening < 1) contactOpening = 1;
+    if (contactOpening > 100) contactOpening = 100;
+
+    // Most of the flow change happens just after the seat lifts, so the
+    // opening grows with the square of the requested flow, see the header.
+    for (int i = 0; i < POINTS - 1; ++i) {
+        float f = (float)i / (POINTS - 1);
+        _points[i] = (uint8_t)(contactOpening * f * f + 0.5f);
+    }
+    // Full flow retracts the pin completely, clear of the insert.
+    _points[POINTS - 1] = 100;
+    _saturation = contactOpening;
+    _calibrated = true;
+}
+
+void ValveCharacteristic::load() {
+    Preferences prefs;
+    prefs.begin(_nvsNamespace, true);
+    uint8_t stored[POINTS];
+    size_t len = prefs.getBytes(NVS_KEY_CURVE, stored, sizeof(stored));
+    _backlashSteps = prefs.getUChar(NVS_KEY_BACKLASH, 0);
+    uint8_t saturation = prefs.getUChar(NVS_KEY_SATURATION, 100);
+    prefs.end();
+
+    if (len != sizeof(stored) || !setPoints(stored, POINTS)) {
+        reset();
+    } else if (saturation >= _points[POINTS - 2] && saturation <= 100) {
+        _saturation = saturation;  // Curves saved before this key saturate at 100
+    }
+}
+
+void ValveCharacteristic::save() const {
+    Preferences prefs;
+    prefs.begin(_nvsNamespace, false);
+    prefs.putBytes(NVS_KEY_CURVE, _points, sizeof(_points));
+    prefs.putUChar(NVS_KEY_BACKLASH, _backlashSteps);
+    prefs.putUChar(NVS_KEY_SATURATION, _saturation);
+    prefs.end();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+
+// Per-valve flow characteristic: maps a requested flow percentage to the
+// valve opening (0 = pin fully pressed, 100 = pin fully retracted).
+// Stored as a small table at fixed flow steps and linearly interpolated.
+// Also keeps the drive's backlash, measured in the same calibration run.
+//
+// A curve built from the contact point models a valve whose flow grows with
+// the square root of the pin's lift off the seat and saturates where the
+// pin leaves the insert: opening = contact * flow^2 below full flow. Openings
+// past the contact point add no flow, so the last segment runs from the 90 %
+// point up to that saturation opening instead of 100; only full flow itself
+// retracts the pin completely. The delivered flow stays continuous that way,
+// rather than 91 % already lifting the pin clear of the insert.
+class ValveCharacteristic {
+public:
+    static constexpr int POINTS = 11;  // flow 0, 10, ..., 100 %
+
+    // One NVS namespace per valve, so each drive keeps its own curve
+    explicit ValveCharacteristic(const char* nvsNamespace = "valve");
+
+    float flowToOpening(float flowPercent) const;
+    float openingToFlow(float openingPercent) const;
+
+    // Replace the table; points must start at 0, end at 100 and never decrease.
+    // Uploaded curves saturate at 100.
+    bool setPoints(const uint8_t* points, int count);
+    // Build a quick-opening curve from the opening at which the pin starts
+    // to press the valve insert (found during the calibration run).
+    void buildFromContactPoint(int contactOpening);
+    void reset();
+
+    bool isCalibrated() const;
+    int saturationOpening() const;  // Opening above which the flow stays at 100 %
+
+    // Steps that only take up play after a change of direction
+    int backlashSteps() const;
+    void setBacklashSteps(int steps);
+
+    void load();
+    void save() const;
+
+private:
+    uint8_t _points[POINTS];
+    uint8_t _saturation;  // Upper end of the last segment below full flow
+    bool _calibrated;
+    uint8_t _backlashSteps;
+    const char* _nvsNamespace;
+};
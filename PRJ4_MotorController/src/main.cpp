@@ -3,15 +3,51 @@
 #include <LoRa.h>
 #include <TMCStepper.h>
 #include <Adafruit_INA219.h>
-
-// INA219 instance
+#include <esp_timer.h>
+#include "ValveCharacteristic.h"
+#include "ValveController.h"
+#include "LoRaProtocol.h"
+#include "TaskLayout.h"
+#include "JitterStats.h"
+#include "FrameAuth.h"
+#include "EnergyMeter.h"
+#include "ValveAxis.h"
+#include "StepScheduler.h"
+
+static_assert(LoRaCommand::CURVE_POINTS == ValveCharacteristic::POINTS, "CURVE frame and valve curve differ");
+
+// INA219 instance, sampled through the energy meter after begin()
 Adafruit_INA219 ina219;
-
-// Stall detection
-volatile bool stallDetected = false;
+EnergyMeter energyMeter;
+
+// Current sampling: fast while the motor runs, slow while it holds
+const uint32_t moveSamplePeriodMs = 2;
+const uint32_t idleSamplePeriodMs = 100;
+volatile bool motorMoving = false;      // Any valve moving, set by the motor task
+volatile bool moveClosing = false;      // Direction of the valve that started the move
+TaskHandle_t monitorTaskHandle = NULL;  // Woken when a move starts
+TaskHandle_t motorTaskHandle = NULL;    // Woken by stepTimer
+esp_timer_handle_t stepTimer = NULL;
+
+// Stall detection. The INA219 sees the motor supply shared by all valves;
+// per valve the TMC2209 StallGuard load is polled over UART while it moves.
 const float stallCurrentThreshold = 1000.0f;  // in milliamps (adjust as needed)
-const int stallSampleLimit = 5;              // number of samples over threshold to count as stall
-int stallCounter = 0;
+const unsigned long stallDurationMs = 500;    // time over threshold to count as stall
+const uint8_t stallGuardThreshold = 40;       // SGTHRS, a SG_RESULT below twice this is a stall
+const uint32_t stallGuardPollMs = 20;         // Per moving valve
+const int stallGuardSettlePolls = 5;          // Ignored while a move gets going
+const int stallGuardLowLimit = 3;             // Consecutive low readings to count as stall
+
+// Calibration: the pin touching the valve insert shows up as a current rise
+const float contactCurrentDelta = 80.0f;     // mA above the free-running baseline
+const int contactSampleLimit = 2;            // consecutive samples above baseline
+const int calibrationBaselineSamples = 5;    // steps used to learn the baseline
+
+// Backlash: the printed adapter and the pin have play, so after a change of
+// direction the first steps only take it up. Measured during calibration.
+const int backlashProbeSteps = 5;            // pressed past the contact point before backing off
+const int maxBacklashSteps = 20;
+const int minReverseSteps = 3;               // smaller reversals wait to be merged with the next move
 
 
 // LoRa Pins
@@ -22,53 +58,259 @@ int stallCounter = 0;
 #define LORA_RST 23
 #define LORA_DI0 26
 
-// Stepper Pins
-#define STEP_PIN 12
-#define DIR_PIN 14
-#define EN_PIN 13   // Enable pin for driver, set as needed
-
-// TMC2209 Settings
+// Stepper Pins, one STEP/DIR pair per valve drive
+#define STEP_PIN_0 12
+#define DIR_PIN_0 14
+#define STEP_PIN_1 25
+#define DIR_PIN_1 33
+#define STEP_PIN_2 32
+#define DIR_PIN_2 4
+#define STEP_PIN_3 16
+#define DIR_PIN_3 17
+#define EN_PIN 13   // Enable pin shared by all drivers, set as needed
+
+// TMC2209 Settings. The drivers share the UART and are told apart by their
+// MS1/MS2 address, 0 to VALVE_AXES - 1. Build with -DVALVE_AXES=<n> for
+// more than one valve.
 #define R_SENSE 0.11f
-#define DRIVER_ADDRESS 0b00
+#ifndef VALVE_AXES
+#define VALVE_AXES 1
+#endif
 
-// UART for TMC2209
-#define UART_RX_PIN 13
+// UART for TMC2209. RX was on 13 together with EN_PIN, which read the enable
+// level back instead of SG_RESULT; 34 is free and input-only is enough for RX.
+#define UART_RX_PIN 34
 #define UART_TX_PIN 15
+static_assert(UART_RX_PIN != EN_PIN && UART_TX_PIN != EN_PIN, "TMC2209 UART must not share the enable pin");
 
 // Constants
 const int MAX_POSITION = 100;  // Fully pressed position (forward)
 
+// Step timing: every valve steps once per stepPeriodUs. The valves' pulses
+// are stepSlotUs apart (see StepScheduler.h), which leaves most of the
+// period free for the monitor task.
+const uint32_t stepPeriodUs = 3000;
+const uint32_t stepSlotUs = 250;
+const uint32_t stepPulseUs = 20;
+// Between steps the motor task sleeps on stepTimer, which fires this early
+// to cover the wake-up; the rest and any shorter wait is busy-waited
+const uint32_t stepWakeMarginUs = 50;
+
 // Global state
-volatile int currentValvePosition = 0;   // Current step position (0-100)
-volatile int targetValvePosition = 0;    // Target step position (0-100)
-volatile bool commandReceived = false;   // Flag for first command received
+volatile uint8_t calibrationRequests = 0;  // Bit per valve
+volatile bool calibrating = false;
+
+// Position, target and learned curve per valve drive
+ValveAxis axes[VALVE_AXES] = {
+  {0, STEP_PIN_0, DIR_PIN_0, &Serial2, R_SENSE},
+#if VALVE_AXES > 1
+  {1, STEP_PIN_1, DIR_PIN_1, &Serial2, R_SENSE},
+#endif
+#if VALVE_AXES > 2
+  {2, STEP_PIN_2, DIR_PIN_2, &Serial2, R_SENSE},
+#endif
+#if VALVE_AXES > 3
+  {3, STEP_PIN_3, DIR_PIN_3, &Serial2, R_SENSE},
+#endif
+};
+static_assert(VALVE_AXES >= 1 && VALVE_AXES <= StepScheduler::MAX_AXES, "One to four TMC2209 addresses");
+const uint8_t ALL_AXES_MASK = (1 << VALVE_AXES) - 1;
+
+// Status reporting back to the remote
+int lastRssi = 0;                        // Link quality of the last command
+float lastSnr = 0.0f;
+
+// Local control: the remote only sends "CTRL:<setpoint>,<room temp>" and the
+// valve loop runs here, so small corrections don't need a radio round-trip
+const unsigned long localControlPeriodMs = 10000;
+const unsigned long linkTimeoutMs = 30UL * 60UL * 1000UL;  // Remote sends at least every 10 min
+const int fallbackValvePercent = 30;                       // Keeps the room from freezing
+volatile bool localControlActive = false;
+volatile float localSetpoint = 0.0f;
+volatile float localRoomTemp = 0.0f;
+volatile float localSupplyTemp = NAN;
+volatile unsigned long lastControlPacketMs = 0;
+ValveController valveController;
+
+// Every frame is authenticated, see FrameAuth.h
+FrameAuth frameAuth('M', 'R');
+
+// Step and sample timing, reported with -DJITTER_REPORT (steps of valve 0)
+JitterStats stepJitter("Step", stepPeriodUs);
+JitterStats monitorJitter("Monitor", moveSamplePeriodMs * 1000);
+
+void stallAxis(ValveAxis& axis, const char* source, float value) {
+  Serial.printf("[Monitor] Stall detected on valve %d! %s: %.0f\n", axis.index, source, value);
+  axis.stallDetected = true;
+  axis.commandReceived = false;  // stop this valve
+  axis.statusPending = true;
+}
+
+// One StallGuard reading; low values mean high load. The first readings of
+// a move are skipped, the load estimate needs a few steps to settle.
+void pollStallGuard(ValveAxis& axis) {
+  uint16_t load = axis.driver.SG_RESULT();
+  if (++axis.stallGuardPolls <= stallGuardSettlePolls) return;
 
-// Initialize Serial2 for TMC2209
-TMC2209Stepper driver(&Serial2, R_SENSE, DRIVER_ADDRESS);
+  if (load >= 2 * stallGuardThreshold) {
+    axis.stallGuardLow = 0;
+  } else if (++axis.stallGuardLow >= stallGuardLowLimit) {
+    stallAxis(axis, "StallGuard", load);
+  }
+}
 
 void taskMonitorCurrent(void *pvParameters) {
   Serial.println("[Monitor] Current monitor started");
+  monitorTaskHandle = xTaskGetCurrentTaskHandle();
+  TickType_t lastWake = xTaskGetTickCount();
+  bool wasMoving = false;
+  unsigned long overThresholdSinceMs = 0;
+  uint8_t lastMovingMask = 0;
+  uint8_t movedMask = 0;        // Valves that moved during this move
+  int mostMoving = 0;           // Most valves moving at once
+  unsigned long lastPollMs = 0;
+  int pollAxis = 0;
 
   for (;;) {
-    float current_mA = ina219.getCurrent_mA();
-
-    if (current_mA > stallCurrentThreshold) {
-      stallCounter++;
+    if (wasMoving) {
+      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(moveSamplePeriodMs));
+      monitorJitter.tick();
     } else {
-      stallCounter = 0;
+      // The motor task wakes us as soon as a move starts
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idleSamplePeriodMs));
+      lastWake = xTaskGetTickCount();
+      monitorJitter.restart();
+    }
+
+    if (calibrating) {
+      // Calibration presses into the insert on purpose
+      overThresholdSinceMs = 0;
+      continue;
+    }
+
+    float current_mA = 0.0f, busVoltage_V = 0.0f;
+    bool sampled = energyMeter.sample(current_mA, busVoltage_V);
+    uint32_t nowUs = micros();
+
+    uint8_t movingMask = 0;
+    int movingCount = 0;
+    for (int i = 0; i < VALVE_AXES; ++i) {
+      if (!axes[i].moving) continue;
+      movingMask |= 1 << i;
+      movingCount++;
+      if (!(lastMovingMask & (1 << i))) axes[i].stallGuardPolls = axes[i].stallGuardLow = 0;
     }
+    lastMovingMask = movingMask;
 
-    if (stallCounter >= stallSampleLimit) {
-      Serial.printf("[Monitor] Stall detected! Current: %.2f mA\n", current_mA);
-      stallDetected = true;
-      commandReceived = false;  // stop motor movement
-      stallCounter = 0;
+    bool moving = movingMask != 0;
+    if (moving && !wasMoving) {
+      energyMeter.startMove(nowUs, moveClosing);
+      movedMask = 0;
+      mostMoving = 0;
     }
+    movedMask |= movingMask;
+    mostMoving = max(mostMoving, movingCount);
+    if (sampled) energyMeter.addSample(nowUs, current_mA, busVoltage_V);
+    if (!moving && wasMoving) {
+      const MoveProfile& move = energyMeter.finishMove(nowUs, mostMoving);
+      Serial.printf("[Energy] Move: %u ms, peak %.0f mA, mean %.0f mA, %.1f mJ (%u samples, %d valves)\n",
+                    (unsigned)move.durationMs, move.peak_mA, move.mean_mA, move.energy_mJ, move.samples, mostMoving);
+      if (energyMeter.isSeizing()) Serial.println("[Energy] Moves need more current than usual, valve may be seizing");
+      for (int i = 0; i < VALVE_AXES; ++i) {
+        if (movedMask & (1 << i)) axes[i].statusPending = true;
+      }
+    }
+    wasMoving = moving;
+
+    // One moving valve per poll, so a UART read never delays the next
+    // current sample by more than about a millisecond
+    if (moving && millis() - lastPollMs >= stallGuardPollMs / movingCount) {
+      lastPollMs = millis();
+      do {
+        pollAxis = (pollAxis + 1) % VALVE_AXES;
+      } while (!(movingMask & (1 << pollAxis)));
+      pollStallGuard(axes[pollAxis]);
+    }
+    if (!sampled) continue;
+
+    for (int i = 0; i < VALVE_AXES; ++i) {
+      if ((movingMask & (1 << i)) && current_mA > axes[i].peakCurrent_mA) axes[i].peakCurrent_mA = current_mA;
+    }
+
+    if (current_mA <= stallCurrentThreshold) {
+      overThresholdSinceMs = 0;
+    } else if (overThresholdSinceMs == 0) {
+      overThresholdSinceMs = millis();
+    } else if (millis() - overThresholdSinceMs >= stallDurationMs) {
+      // With one valve moving the supply current is its own. With several,
+      // StallGuard should have named the culprit by now, so stop them all.
+      for (int i = 0; i < VALVE_AXES; ++i) {
+        if (movingMask & (1 << i)) stallAxis(axes[i], "Current mA", current_mA);
+      }
+      overThresholdSinceMs = 0;
+    }
+  }
+}
+
+
+int currentValvePercent(const ValveAxis& axis) {
+  return round(axis.characteristic.openingToFlow(MAX_POSITION - axis.position));
+}
+
+// Valves addressed by a command, see LoRaCommand::axis
+uint8_t axisMask(int axis) {
+  if (axis == LoRaCommand::ALL_AXES) return ALL_AXES_MASK;
+  if (axis < VALVE_AXES) return 1 << axis;
+  Serial.printf("[Valve] No valve %d on this controller\n", axis);
+  return 0;
+}
 
-    vTaskDelay(pdMS_TO_TICKS(100));  // check every 100ms
+// Move the valve to a flow percentage (0 = closed, 100 = fully open)
+void setValveTarget(ValveAxis& axis, float valvePercent) {
+  int newTarget = MAX_POSITION - round(axis.characteristic.flowToOpening(valvePercent));
+
+  if (newTarget < 0) newTarget = 0;
+  if (newTarget > MAX_POSITION) newTarget = MAX_POSITION;
+
+  axis.target = newTarget;
+  axis.commandedPercent = valvePercent;
+  axis.peakCurrent_mA = 0.0f;
+  axis.stallDetected = false;
+  axis.commandReceived = true;
+
+  Serial.printf("[Valve %d] valvePercent=%.2f, targetValvePosition=%d\n", axis.index, valvePercent, newTarget);
+}
+
+void setValveTargets(uint8_t mask, float valvePercent) {
+  for (int i = 0; i < VALVE_AXES; ++i) {
+    if (mask & (1 << i)) setValveTarget(axes[i], valvePercent);
   }
 }
 
+// Report "STAT[@<axis>]:<actual %>,<target %>,<stall>,<peak mA>,<rssi>,<snr>,..." to the remote
+void sendStatus(const ValveAxis& axis) {
+  StatusReport report;
+  report.axis = axis.index;
+  report.actualPercent = currentValvePercent(axis);
+  report.targetPercent = round(axis.commandedPercent);
+  report.stalled = axis.stallDetected;
+  report.peakCurrent_mA = axis.peakCurrent_mA;
+  report.rssi = lastRssi;
+  report.snr = lastSnr;
+  report.moveEnergy_mJ = round(energyMeter.lastMove().energy_mJ);
+  report.totalEnergy_J = energyMeter.totalEnergy_mJ() / 1000;
+  report.seizing = energyMeter.isSeizing();
+
+  char payload[64 + FrameAuth::OVERHEAD];
+  report.format(payload, sizeof(payload));
+  if (!frameAuth.seal(payload, sizeof(payload))) return;
+
+  LoRa.beginPacket();
+  LoRa.print(payload);
+  LoRa.endPacket();
+
+  Serial.printf("[LoRaRecv] Sent status: %s\n", payload);
+}
 
 // --- LoRa receive task ---
 void taskLoRaReceive(void *pvParameters) {
@@ -77,72 +319,372 @@ void taskLoRaReceive(void *pvParameters) {
   for (;;) {
     int packetSize = LoRa.parsePacket();
     if (packetSize) {
-      String incoming = "";
+      char incoming[64 + FrameAuth::OVERHEAD];
+      int len = 0;
       while (LoRa.available()) {
-        incoming += (char)LoRa.read();
+        char c = (char)LoRa.read();
+        if (len < (int)sizeof(incoming) - 1) incoming[len++] = c;
       }
-      incoming.trim();
+      incoming[len] = '\0';
+      lastRssi = LoRa.packetRssi();
+      lastSnr = LoRa.packetSnr();
 
       Serial.print("[LoRaRecv] Received: ");
       Serial.println(incoming);
 
-      String incomingUpper = incoming;
-      incomingUpper.toUpperCase();
-      if (incomingUpper.startsWith("VALVE:")) {
-        String valStr = incoming.substring(6);
-        float valvePercent = valStr.toFloat();
+      LoRaCommand command;
+      if (!frameAuth.open(incoming)) {
+        Serial.printf("[LoRaRecv] Dropped unauthenticated frame (%u so far)\n", (unsigned)frameAuth.rejectedFrames());
+      } else if (LoRaCommand::parse(incoming, command)) {
+        switch (command.type) {
+          case LoRaCommand::VALVE:
+            localControlActive = false;  // Remote drives the valves directly again
+            setValveTargets(axisMask(command.axis), command.valvePercent);
+            break;
+          case LoRaCommand::CTRL:
+            localSetpoint = command.setpoint;
+            localRoomTemp = command.roomTemp;
+            localSupplyTemp = command.supplyTemp;
+            lastControlPacketMs = millis();
+            localControlActive = true;
+            Serial.printf("[LoRaRecv] setpoint=%.1f, room=%.2f\n", command.setpoint, command.roomTemp);
+            break;
+          case LoRaCommand::CALIBRATE:
+            calibrationRequests |= axisMask(command.axis);
+            Serial.println("[LoRaRecv] Calibration requested");
+            break;
+          case LoRaCommand::CURVE:
+            for (int i = 0; i < VALVE_AXES; ++i) {
+              if (!(axisMask(command.axis) & (1 << i))) continue;
+              if (axes[i].characteristic.setPoints(command.curve, ValveCharacteristic::POINTS)) {
+                axes[i].characteristic.save();
+                Serial.printf("[LoRaRecv] Valve %d curve updated\n", i);
+              } else {
+                Serial.println("[LoRaRecv] Invalid valve curve");
+              }
+            }
+            break;
+          default:
+            break;
+        }
+      }
+    }
 
-        if (valvePercent >= 0.0f && valvePercent <= 100.0f) {
-          int newTarget = MAX_POSITION - round(valvePercent);
+    // The radio is only touched from this task, so status goes out from here
+    for (int i = 0; i < VALVE_AXES; ++i) {
+      if (!axes[i].statusPending) continue;
+      axes[i].statusPending = false;
+      sendStatus(axes[i]);
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+}
 
-          if (newTarget < 0) newTarget = 0;
-          if (newTarget > MAX_POSITION) newTarget = MAX_POSITION;
+// Slow blocking step for homing and calibration, outside the scheduler
+void stepPulse(const ValveAxis& axis) {
+  digitalWrite(axis.stepPin, HIGH);
+  delayMicroseconds(1000);
+  digitalWrite(axis.stepPin, LOW);
+  delayMicroseconds(1000);
+}
 
-          targetValvePosition = newTarget;
-          stallDetected = false;      
-          commandReceived = true;
+// Press backlashProbeSteps past the contact point, then back off until the
+// current drops to the free-running baseline. The drive first turns through
+// the play and then the pin travels the probe steps back to the insert.
+// Returns the play in steps, or -1 when the load never went away.
+int measureBacklash(ValveAxis& axis, int contactPosition, float baseline) {
+  digitalWrite(axis.dirPin, LOW);
+  while (axis.position > contactPosition - backlashProbeSteps) {
+    stepPulse(axis);
+    axis.position = axis.position - 1;
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  digitalWrite(axis.dirPin, HIGH);
+  while (axis.position < contactPosition + backlashProbeSteps) {
+    stepPulse(axis);
+    axis.position = axis.position + 1;
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
 
-          Serial.printf("[LoRaRecv] valvePercent=%.2f, targetValvePosition=%d\n", valvePercent, targetValvePosition);
-        }
+  digitalWrite(axis.dirPin, LOW);
+  int steps = 0;
+  int releasedCount = 0;
+  while (steps < backlashProbeSteps + maxBacklashSteps) {
+    stepPulse(axis);
+    steps++;
+    vTaskDelay(pdMS_TO_TICKS(5));  // let the current settle
+
+    float current_mA = 0.0f, busVoltage_V;
+    energyMeter.sample(current_mA, busVoltage_V);
+    if (current_mA < baseline + contactCurrentDelta / 2) {
+      if (++releasedCount >= contactSampleLimit) break;
+    } else {
+      releasedCount = 0;
+    }
+  }
+  axis.lastStepDirection = LOW;
+  if (releasedCount < contactSampleLimit) {
+    axis.position = contactPosition;  // Best guess, the end of calibration closes fully anyway
+    return -1;
+  }
+
+  int backlash = max(steps - contactSampleLimit + 1 - backlashProbeSteps, 0);
+  axis.position = contactPosition + backlashProbeSteps - (steps - backlash);
+  return backlash;
+}
+
+// Retract fully, then close step by step and find where the pin starts to
+// press the valve insert. Everything before that point does not change flow.
+void runCalibration(ValveAxis& axis) {
+  calibrating = true;
+  Serial.printf("[Calib] Valve %d: retracting to fully open\n", axis.index);
+
+  digitalWrite(axis.dirPin, LOW);
+  while (axis.position > 0) {
+    stepPulse(axis);
+    axis.position = axis.position - 1;
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+
+  float baseline = 0.0f;
+  int overCount = 0;
+  int contactPosition = -1;
+
+  digitalWrite(axis.dirPin, HIGH);
+  while (axis.position < MAX_POSITION) {
+    stepPulse(axis);
+    axis.position = axis.position + 1;
+    vTaskDelay(pdMS_TO_TICKS(5));  // let the current settle
+
+    float current_mA = 0.0f, busVoltage_V;
+    energyMeter.sample(current_mA, busVoltage_V);
+    if (axis.position <= calibrationBaselineSamples) {
+      baseline += current_mA / calibrationBaselineSamples;
+      continue;
+    }
+
+    if (contactPosition < 0) {
+      if (current_mA > baseline + contactCurrentDelta) {
+        overCount++;
+        if (overCount >= contactSampleLimit) contactPosition = axis.position - contactSampleLimit + 1;
+      } else {
+        overCount = 0;
       }
     }
-    vTaskDelay(pdMS_TO_TICKS(100));
   }
+
+  if (contactPosition > 0) {
+    // The sweep started right after retracting, so its first steps took up
+    // the play and the pin really touched that much later
+    int backlash = measureBacklash(axis, contactPosition, baseline);
+    if (backlash >= 0) {
+      axis.characteristic.setBacklashSteps(backlash);
+      contactPosition = max(contactPosition - backlash, 1);
+    }
+
+    int contactOpening = MAX_POSITION - contactPosition;
+    axis.characteristic.buildFromContactPoint(contactOpening * 100 / MAX_POSITION);
+    axis.characteristic.save();
+    Serial.printf("[Calib] Valve %d: contact at position %d (baseline %.1f mA), backlash %d steps%s\n", axis.index, contactPosition,
+                  baseline, axis.characteristic.backlashSteps(), backlash < 0 ? " (not measured)" : "");
+  } else {
+    Serial.printf("[Calib] Valve %d: no contact point found, keeping previous curve\n", axis.index);
+  }
+
+  // Calibration ends fully pressed, same as after homing
+  digitalWrite(axis.dirPin, HIGH);
+  int takeUp = (axis.lastStepDirection == LOW) ? axis.characteristic.backlashSteps() : 0;
+  for (int i = 0; i < takeUp; ++i) {
+    stepPulse(axis);
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  while (axis.position < MAX_POSITION) {
+    stepPulse(axis);
+    axis.position = axis.position + 1;
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  axis.lastStepDirection = HIGH;
+  axis.target = MAX_POSITION;
+  axis.commandReceived = false;
+  calibrating = false;
 }
 
-// --- Motor control task ---
-void taskMotorControl(void *pvParameters) {
-  Serial.println("[MotorTask] Started");
+// --- Local control task ---
+// Same ValveController as the remote, fed with the last received room
+// temperature every cycle. Falls back to a fixed opening when the link drops.
+// All valves follow it, valve 0 stands in for them in the controller.
+void taskLocalControl(void *pvParameters) {
+  Serial.println("[LocalCtrl] Task started");
+  int lastAppliedPercent = -1;
+  bool fallbackActive = false;
+  bool stallHandled = false;
 
   for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(localControlPeriodMs));
+    if (!localControlActive) {
+      lastAppliedPercent = -1;
+      continue;
+    }
 
-    if (!commandReceived || stallDetected) {
-      vTaskDelay(pdMS_TO_TICKS(20));
+    if (millis() - lastControlPacketMs > linkTimeoutMs) {
+      if (!fallbackActive) {
+        fallbackActive = true;
+        Serial.println("[LocalCtrl] Link lost, moving to fallback position");
+        valveController.setValvePosition(fallbackValvePercent);
+        lastAppliedPercent = fallbackValvePercent;
+        setValveTargets(ALL_AXES_MASK, fallbackValvePercent);
+      }
       continue;
     }
+    fallbackActive = false;
 
+    if (lastAppliedPercent < 0) {
+      // Just switched to local control, continue from where the valve is
+      valveController.setValvePosition(currentValvePercent(axes[0]));
+      lastAppliedPercent = valveController.getValvePosition();
+    }
 
-    if (targetValvePosition != currentValvePosition) {
-      int direction = (targetValvePosition > currentValvePosition) ? HIGH : LOW;
-      digitalWrite(DIR_PIN, direction);
+    bool anyStalled = false;
+    for (const ValveAxis& axis : axes) anyStalled = anyStalled || axis.stallDetected;
+    if (anyStalled && !stallHandled) {
+      stallHandled = true;
+      valveController.applyActuatorStatus(currentValvePercent(axes[0]), true);
+    }
 
-      // Pulse step pin
-      digitalWrite(STEP_PIN, HIGH);
-      delayMicroseconds(1000);
-      digitalWrite(STEP_PIN, LOW);
-      delayMicroseconds(1000);
+    float roomTemp = localRoomTemp;
+    valveController.recordTemperature(roomTemp);
+    valveController.update(roomTemp, localSetpoint, localSupplyTemp);
 
-      if (direction == HIGH) {
-        currentValvePosition = min(currentValvePosition + 1, MAX_POSITION);
-      } else {
-        currentValvePosition = max(currentValvePosition - 1, 0);
+    int valvePercent = valveController.getValvePosition();
+    if (valvePercent != lastAppliedPercent) {
+      lastAppliedPercent = valvePercent;
+      stallHandled = false;
+      setValveTargets(ALL_AXES_MASK, valvePercent);
+    }
+  }
+}
+
+// --- Motor control task ---
+// Decides whether a valve starts moving towards its target. A small reversal
+// costs more steps of play than it moves the pin, so it is held; the next
+// command either cancels it or makes it worth it. Fully open and fully
+// closed are always reached.
+bool startMove(ValveAxis& axis) {
+  int target = axis.target;
+  int direction = (target > axis.position) ? HIGH : LOW;
+  bool reversal = axis.lastStepDirection >= 0 && direction != axis.lastStepDirection;
+  if (reversal && abs(target - axis.position) < minReverseSteps && target != 0 && target != MAX_POSITION) {
+    if (axis.heldTarget != target) {
+      axis.heldTarget = target;
+      axis.statusPending = true;
+      Serial.printf("[MotorTask] Valve %d holding small reversal to %d at %d\n", axis.index, target, axis.position);
+    }
+    return false;
+  }
+  axis.heldTarget = -1;
+  return true;
+}
+
+// Raises the STEP pin of a moving valve, or returns false once it has
+// arrived or was stopped. The direction is checked on every step, so a new
+// target mid-move turns the valve around; the play is taken up first.
+bool beginStep(ValveAxis& axis) {
+  if (!axis.commandReceived || axis.stallDetected) return false;
+  int target = axis.target;
+  if (target == axis.position) return false;
+
+  int direction = (target > axis.position) ? HIGH : LOW;
+  if (direction != axis.lastStepDirection) {
+    digitalWrite(axis.dirPin, direction);
+    if (axis.lastStepDirection >= 0) axis.takeUpSteps = axis.characteristic.backlashSteps();
+    axis.lastStepDirection = direction;
+  }
+  digitalWrite(axis.stepPin, HIGH);
+  return true;
+}
+
+void endStep(ValveAxis& axis) {
+  digitalWrite(axis.stepPin, LOW);
+  if (axis.takeUpSteps > 0) {
+    axis.takeUpSteps--;  // Play, the pin didn't move
+  } else if (axis.lastStepDirection == HIGH) {
+    axis.position = min(axis.position + 1, MAX_POSITION);
+  } else {
+    axis.position = max(axis.position - 1, 0);
+  }
+}
+
+void onStepTimer(void *arg) {
+  if (motorTaskHandle != NULL) xTaskNotifyGive(motorTaskHandle);
+}
+
+// Steps every moving valve in its own slot of the step period, see
+// StepScheduler.h. Waits between slots sleep on stepTimer, so the monitor
+// task gets core 1 there too; only the last stepWakeMarginUs are spun.
+void taskMotorControl(void *pvParameters) {
+  motorTaskHandle = xTaskGetCurrentTaskHandle();
+  Serial.println("[MotorTask] Started");
+  StepScheduler scheduler(stepPeriodUs, stepSlotUs);
+
+  for (;;) {
+    // Calibration needs the motor supply to itself, running moves finish first
+    if (calibrationRequests && !scheduler.anyActive()) {
+      for (int i = 0; i < VALVE_AXES; ++i) {
+        if (!(calibrationRequests & (1 << i))) continue;
+        calibrationRequests &= ~(1 << i);
+        runCalibration(axes[i]);
       }
+      continue;
+    }
 
-      Serial.printf("[MotorTask] Moving step: %d / %d\n", currentValvePosition, targetValvePosition);
+    uint32_t nowUs = micros();
+    for (int i = 0; i < VALVE_AXES && !calibrationRequests; ++i) {
+      ValveAxis& axis = axes[i];
+      if (scheduler.isActive(i) || !axis.commandReceived || axis.stallDetected || axis.target == axis.position) {
+        continue;
+      }
+      if (!startMove(axis)) continue;
+      if (!scheduler.anyActive()) {
+        if (i == 0) stepJitter.restart();
+        moveClosing = (axis.target > axis.position);
+        motorMoving = true;
+        if (monitorTaskHandle != NULL) xTaskNotifyGive(monitorTaskHandle);
+      }
+      axis.moving = true;
+      scheduler.start(i, nowUs);
+    }
 
-      vTaskDelay(pdMS_TO_TICKS(1));
-    } else {
+    uint8_t due = scheduler.due(nowUs);
+    uint8_t stepping = 0;
+    for (int i = 0; i < VALVE_AXES; ++i) {
+      if (!(due & (1 << i))) continue;
+      if (beginStep(axes[i])) {
+        stepping |= 1 << i;
+        continue;
+      }
+      scheduler.stop(i);
+      axes[i].moving = false;  // The monitor task closes the move profile and reports
+      Serial.printf("[MotorTask] Valve %d move done: %d / %d\n", i, axes[i].position, axes[i].target);
+      if (!scheduler.anyActive()) motorMoving = false;
+    }
+    if (stepping) {
+      delayMicroseconds(stepPulseUs);
+      for (int i = 0; i < VALVE_AXES; ++i) {
+        if (stepping & (1 << i)) endStep(axes[i]);
+      }
+      if (stepping & 1) stepJitter.tick();
+    }
+
+    // No Serial output per step, a blocking UART write stretches the step period
+    if (!scheduler.anyActive()) {
       vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    uint32_t waitUs = scheduler.untilNext(micros());
+    if (waitUs > 2 * stepWakeMarginUs && esp_timer_start_once(stepTimer, waitUs - stepWakeMarginUs) == ESP_OK) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitUs / 1000 + 2));
+    } else if (waitUs > 0) {
+      delayMicroseconds(waitUs);
     }
   }
 }
@@ -157,24 +699,34 @@ if (!ina219.begin()) {
   Serial.println("INA219 not found. Check wiring.");
   while (1);  // halt if INA not found
 }
+energyMeter.begin();
 
 
 
   // Setup pins
-  pinMode(STEP_PIN, OUTPUT);
-  pinMode(DIR_PIN, OUTPUT);
+  for (const ValveAxis& axis : axes) {
+    pinMode(axis.stepPin, OUTPUT);
+    pinMode(axis.dirPin, OUTPUT);
+    digitalWrite(axis.stepPin, LOW);
+    digitalWrite(axis.dirPin, LOW);
+  }
   pinMode(EN_PIN, OUTPUT);
-  digitalWrite(STEP_PIN, LOW);
-  digitalWrite(DIR_PIN, LOW);
 
   // Enable driver
   digitalWrite(EN_PIN, LOW);  // LOW to enable (depends on your wiring)
 
   // Setup UART for TMC2209
   Serial2.begin(115200, SERIAL_8N1, UART_RX_PIN, UART_TX_PIN);
-  driver.begin();
-  driver.rms_current(600);       // Set motor current in mA
-  driver.microsteps(16);         // Set microsteps (e.g. 16)
+  for (ValveAxis& axis : axes) {
+    axis.driver.begin();
+    axis.driver.rms_current(600);     // Set motor current in mA
+    axis.driver.microsteps(16);       // Set microsteps (e.g. 16)
+    // StallGuard4 works in StealthChop, above the TCOOLTHRS step rate
+    axis.driver.en_spreadCycle(false);
+    axis.driver.TCOOLTHRS(0xFFFFF);
+    axis.driver.SGTHRS(stallGuardThreshold);
+    if (axis.driver.test_connection() != 0) Serial.printf("TMC2209 at address %d not answering.\n", axis.index);
+  }
 
   // Setup LoRa
   SPI.begin(LORA_SCK, LORA_MISO, LORA_MOSI, LORA_SS);
@@ -184,28 +736,64 @@ if (!ina219.begin()) {
     while (1);
   }
   Serial.println("LoRa init OK.");
+  frameAuth.begin();
 
-  // Move motor fully forward 100 steps on startup
+  for (ValveAxis& axis : axes) {
+    axis.characteristic.load();
+    Serial.printf("Valve %d: %s, backlash compensation %d steps\n", axis.index,
+                  axis.characteristic.isCalibrated() ? "curve loaded" : "curve not calibrated, using linear",
+                  axis.characteristic.backlashSteps());
+  }
+
+  // Move motors fully forward 100 steps on startup
   Serial.println("Homing: moving fully forward 100 steps...");
-  digitalWrite(DIR_PIN, HIGH);
+  for (const ValveAxis& axis : axes) digitalWrite(axis.dirPin, HIGH);
   for (int i = 0; i < MAX_POSITION; i++) {
-    digitalWrite(STEP_PIN, HIGH);
-    delayMicroseconds(1000);
-    digitalWrite(STEP_PIN, LOW);
-    delayMicroseconds(1000);
+    for (const ValveAxis& axis : axes) stepPulse(axis);
   }
-  currentValvePosition = MAX_POSITION;
-  targetValvePosition = MAX_POSITION;
-  commandReceived = false;
+  for (ValveAxis& axis : axes) {
+    axis.position = MAX_POSITION;
+    axis.target = MAX_POSITION;
+    axis.lastStepDirection = HIGH;
+    axis.commandReceived = false;
+  }
+
+  // Allocates, so before the tasks and lockHeap()
+  esp_timer_create_args_t stepTimerArgs = {};
+  stepTimerArgs.callback = onStepTimer;
+  stepTimerArgs.name = "step";
+  if (esp_timer_create(&stepTimerArgs, &stepTimer) != ESP_OK) Serial.println("Step timer failed, steps busy-wait.");
 
-  // Start FreeRTOS tasks
-  xTaskCreate(taskLoRaReceive, "LoRaRecv", 2048, NULL, 1, NULL);
-  xTaskCreate(taskMotorControl, "MotorCtrl", 2048, NULL, 1, NULL);
-  xTaskCreate(taskMonitorCurrent, "MonitorCurrent", 2048, NULL, 1, NULL);
+  // Start FreeRTOS tasks, see TaskLayout.h
+  CREATE_TASK(taskMotorControl, "MotorCtrl", STACK_MOTOR, PRIO_MOTOR, CORE_REALTIME);
+  CREATE_TASK(taskMonitorCurrent, "MonitorCurrent", STACK_MONITOR, PRIO_MONITOR, CORE_REALTIME);
+  CREATE_TASK(taskLoRaReceive, "LoRaRecv", STACK_LORA, PRIO_LORA, CORE_RADIO);
+  CREATE_TASK(taskLocalControl, "LocalCtrl", STACK_LOCAL_CTRL, PRIO_LOCAL_CTRL, CORE_RADIO);
 
   Serial.println("Setup complete");
+
+  // Everything is allocated, see MemoryGuard.h
+  MemoryGuard::lockHeap();
 }
 
 void loop() {
-  // Empty, all work done in tasks
+  // All work is done in tasks. Serial commands: "MEM" prints stack and heap
+  // usage, "ENERGY" the last move profiles, "VALVES" each valve's position,
+  // "KEY <32 hex digits>" sets the LoRa key
+  if (Serial.available()) {
+    char line[48];
+    size_t len = Serial.readBytesUntil('\n', line, sizeof(line) - 1);
+    while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+    line[len] = '\0';
+    if (strcmp(line, "MEM") == 0) MemoryGuard::printReport(Serial);
+    else if (strcmp(line, "ENERGY") == 0) energyMeter.printHistory(Serial);
+    else if (strcmp(line, "VALVES") == 0) {
+      for (const ValveAxis& axis : axes)
+        Serial.printf("Valve %d: position %d, target %d, %d%%%s\n", axis.index, axis.position, axis.target,
+                      currentValvePercent(axis), axis.stallDetected ? ", stalled" : "");
+    }
+    else if (strncmp(line, "KEY ", 4) == 0)
+      Serial.println(frameAuth.provisionKey(line + 4) ? "LoRa key stored" : "Invalid LoRa key");
+  }
+  vTaskDelay(pdMS_TO_TICKS(100));
 }
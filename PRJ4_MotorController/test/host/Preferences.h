@@ -0,0 +1,49 @@
+#pragma once
+// In-memory stand-in for the ESP32 Preferences library, for host tests.
+// Namespaces live until the process ends, so save() and load() round-trip.
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        _name = name;
+        _readOnly = readOnly;
+        return true;
+    }
+    void end() {}
+
+    size_t getBytes(const char* key, void* buf, size_t len) {
+        auto it = store().find(_name + "/" + key);
+        if (it == store().end() || it->second.size() > len) return 0;
+        memcpy(buf, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+    size_t putBytes(const char* key, const void* value, size_t len) {
+        if (_readOnly) return 0;
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        store()[_name + "/" + key].assign(bytes, bytes + len);
+        return len;
+    }
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) {
+        uint8_t value;
+        return getBytes(key, &value, 1) == 1 ? value : defaultValue;
+    }
+    size_t putUChar(const char* key, uint8_t value) {
+        return putBytes(key, &value, 1);
+    }
+
+    static void clearAll() { store().clear(); }
+
+private:
+    static std::map<std::string, std::vector<uint8_t>>& store() {
+        static std::map<std::string, std::vector<uint8_t>> values;
+        return values;
+    }
+
+    std::string _name;
+    bool _readOnly = false;
+};
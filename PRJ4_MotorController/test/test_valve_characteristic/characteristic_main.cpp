@@ -0,0 +1,102 @@
+// Host tests of the valve characteristic, mainly the last segment of a curve
+// built from the contact point.
+//   pio test -e native_characteristic -v
+#include <unity.h>
+#include <Preferences.h>
+#include "ValveCharacteristic.h"
+
+static const int CONTACT = 40;
+
+void setUp() {
+    Preferences::clearAll();
+}
+
+void tearDown() {}
+
+void test_contact_curve_points() {
+    ValveCharacteristic curve;
+    curve.buildFromContactPoint(CONTACT);
+    TEST_ASSERT_TRUE(curve.isCalibrated());
+    TEST_ASSERT_EQUAL(CONTACT, curve.saturationOpening());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, curve.flowToOpening(0.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, curve.flowToOpening(50.0f));  // 40 * 0.5^2
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 32.0f, curve.flowToOpening(90.0f));  // 40 * 0.9^2, rounded
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f, curve.flowToOpening(100.0f));
+}
+
+void test_last_segment_runs_to_the_contact_point() {
+    ValveCharacteristic curve;
+    curve.buildFromContactPoint(CONTACT);
+    // Between the 90 % point and the contact point, not on towards 100
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 36.0f, curve.flowToOpening(95.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 39.2f, curve.flowToOpening(99.0f));
+
+    // No step anywhere below full flow: 0.1 % more flow never moves the pin
+    // further than the steepest segment allows
+    float previous = curve.flowToOpening(89.0f);
+    for (int tenths = 891; tenths < 1000; ++tenths) {
+        float opening = curve.flowToOpening(tenths / 10.0f);
+        TEST_ASSERT_TRUE(opening >= previous);
+        TEST_ASSERT_TRUE(opening - previous <= 0.09f);
+        TEST_ASSERT_TRUE(opening <= CONTACT);
+        previous = opening;
+    }
+}
+
+void test_last_segment_inverts() {
+    ValveCharacteristic curve;
+    curve.buildFromContactPoint(CONTACT);
+    for (float flow = 90.0f; flow < 100.0f; flow += 0.5f) {
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, flow, curve.openingToFlow(curve.flowToOpening(flow)));
+    }
+    // Past the contact point the pin is off the insert
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f, curve.openingToFlow(CONTACT));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f, curve.openingToFlow(70.0f));
+}
+
+void test_uploaded_curve_saturates_at_100() {
+    const uint8_t points[ValveCharacteristic::POINTS] = {0, 5, 10, 20, 30, 40, 50, 60, 70, 80, 100};
+    ValveCharacteristic curve;
+    curve.buildFromContactPoint(CONTACT);
+    TEST_ASSERT_TRUE(curve.setPoints(points, ValveCharacteristic::POINTS));
+    TEST_ASSERT_EQUAL(100, curve.saturationOpening());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 90.0f, curve.flowToOpening(95.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 95.0f, curve.openingToFlow(90.0f));
+}
+
+void test_saturation_is_saved_with_the_curve() {
+    ValveCharacteristic saved("valve0");
+    saved.buildFromContactPoint(CONTACT);
+    saved.save();
+
+    ValveCharacteristic loaded("valve0");
+    loaded.load();
+    TEST_ASSERT_TRUE(loaded.isCalibrated());
+    TEST_ASSERT_EQUAL(CONTACT, loaded.saturationOpening());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 36.0f, loaded.flowToOpening(95.0f));
+}
+
+void test_curve_saved_without_saturation_loads_as_before() {
+    const uint8_t points[ValveCharacteristic::POINTS] = {0, 0, 2, 4, 6, 10, 14, 20, 26, 32, 100};
+    Preferences prefs;
+    prefs.begin("valve0");
+    prefs.putBytes("curve", points, sizeof(points));
+    prefs.end();
+
+    ValveCharacteristic loaded("valve0");
+    loaded.load();
+    TEST_ASSERT_TRUE(loaded.isCalibrated());
+    TEST_ASSERT_EQUAL(100, loaded.saturationOpening());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 66.0f, loaded.flowToOpening(95.0f));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_contact_curve_points);
+    RUN_TEST(test_last_segment_runs_to_the_contact_point);
+    RUN_TEST(test_last_segment_inverts);
+    RUN_TEST(test_uploaded_curve_saturates_at_100);
+    RUN_TEST(test_saturation_is_saved_with_the_curve);
+    RUN_TEST(test_curve_saved_without_saturation_loads_as_before);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+#include "FrameAuth.h"
+#include <mbedtls/cmac.h>
+
+static const char* NVS_NAMESPACE = "lora";
+static const char* NVS_KEY_KEY = "key";
+static const char* NVS_KEY_TX = "txNext";
+static const char* NVS_KEY_RX = "rxLast";
+
+// Both counters are stored once per block instead of once per frame. After
+// a reboot the sender skips the rest of its block, which the receiver does
+// not mind; the receiver takes the rest of its block as already seen, so a
+// replay stays refused at the cost of dropping the sender's frames up to
+// that bound, at most a block of them.
+static const uint32_t TX_BLOCK = 64;
+static const uint32_t RX_BLOCK = 64;
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses exactly len hex digits into value; len must be 1..8
+static bool parseHex(const char* text, size_t len, uint32_t& value) {
+    if (len == 0 || len > 8) return false;
+    value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        int d = hexDigit(text[i]);
+        if (d < 0) return false;
+        value = (value << 4) | d;
+    }
+    return true;
+}
+
+FrameAuth::FrameAuth(char txDirection, char rxDirection)
+    : _txDirection(txDirection), _rxDirection(rxDirection), _persistent(false), _hasKey(false),
+      _txCounter(1), _txReserved(0), _rxLast(0), _rxReserved(0), _rejected(0), _mutex(NULL) {
+    mbedtls_cipher_init(&_cipher);
+}
+
+bool FrameAuth::begin() {
+    if (_mutex == NULL) _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    if (!_prefs.begin(NVS_NAMESPACE, false)) return false;
+    _persistent = true;
+
+    uint8_t key[KEY_BYTES];
+    if (_prefs.getBytes(NVS_KEY_KEY, key, sizeof(key)) != sizeof(key)) {
+        Serial.println("No LoRa key provisioned, send \"KEY <32 hex digits>\" on the serial port.");
+        return false;
+    }
+
+    _txCounter = _prefs.getUInt(NVS_KEY_TX, 1);
+    _txReserved = _txCounter + TX_BLOCK;
+    _prefs.putUInt(NVS_KEY_TX, _txReserved);
+    // The stored bound, not the last frame; older firmware stored the latter
+    _rxLast = _rxReserved = _prefs.getUInt(NVS_KEY_RX, 0);
+    return setKey(key);
+}
+
+bool FrameAuth::hasKey() const {
+    return _hasKey;
+}
+
+bool FrameAuth::provisionKey(const char* hex) {
+    if (strlen(hex) != 2 * KEY_BYTES) return false;
+    uint8_t key[KEY_BYTES];
+    for (int i = 0; i < KEY_BYTES; ++i) {
+        uint32_t byte;
+        if (!parseHex(hex + 2 * i, 2, byte)) return false;
+        key[i] = byte;
+    }
+
+    if (_persistent) {
+        _prefs.putBytes(NVS_KEY_KEY, key, sizeof(key));
+        _prefs.putUInt(NVS_KEY_TX, 1 + TX_BLOCK);
+        _prefs.putUInt(NVS_KEY_RX, 0);
+    }
+    _txCounter = 1;
+    _txReserved = 1 + TX_BLOCK;
+    _rxLast = _rxReserved = 0;
+    return setKey(key);
+}
+
+bool FrameAuth::setKey(const uint8_t* key) {
+    if (_mutex == NULL) _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    // The context and its CMAC state are allocated here once, frames reuse them
+    mbedtls_cipher_free(&_cipher);
+    mbedtls_cipher_init(&_cipher);
+    _hasKey = mbedtls_cipher_setup(&_cipher, mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_ECB)) == 0 &&
+              mbedtls_cipher_cmac_starts(&_cipher, key, KEY_BYTES * 8) == 0;
+    xSemaphoreGive(_mutex);
+    return _hasKey;
+}
+
+void FrameAuth::computeTag(char direction, uint32_t counter, const char* payload, size_t len, uint8_t* tag) {
+    uint8_t header[5] = {(uint8_t)direction, (uint8_t)(counter >> 24), (uint8_t)(counter >> 16),
+                         (uint8_t)(counter >> 8), (uint8_t)counter};
+    uint8_t mac[16];
+    mbedtls_cipher_cmac_reset(&_cipher);
+    mbedtls_cipher_cmac_update(&_cipher, header, sizeof(header));
+    mbedtls_cipher_cmac_update(&_cipher, (const uint8_t*)payload, len);
+    mbedtls_cipher_cmac_finish(&_cipher, mac);
+    memcpy(tag, mac, TAG_BYTES);
+}
+
+bool FrameAuth::seal(char* frame, size_t size) {
+    if (!_hasKey) return false;
+    size_t len = strlen(frame);
+    if (len + OVERHEAD + 1 > size) return false;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint32_t counter = _txCounter++;
+    if (_persistent && _txCounter >= _txReserved) {
+        _txReserved += TX_BLOCK;
+        _prefs.putUInt(NVS_KEY_TX, _txReserved);
+    }
+
+    uint8_t tag[TAG_BYTES];
+    computeTag(_txDirection, counter, frame, len, tag);
+    xSemaphoreGive(_mutex);
+
+    len += snprintf(frame + len, size - len, "|%lx|", (unsigned long)counter);
+    for (int i = 0; i < TAG_BYTES; ++i) {
+        snprintf(frame + len + 2 * i, 3, "%02x", tag[i]);
+    }
+    return true;
+}
+
+// Splits off "|<counter>|<tag>"; false if the frame doesn't end in one
+bool FrameAuth::parseTrailer(char* frame, char*& counterText, uint32_t& counter, uint8_t* tag) {
+    char* tagText = strrchr(frame, '|');
+    if (tagText == NULL || tagText == frame) return false;
+    *tagText = '\0';
+    counterText = strrchr(frame, '|');
+    *tagText++ = '|';
+    if (counterText == NULL || strlen(tagText) != 2 * TAG_BYTES) return false;
+
+    if (!parseHex(counterText + 1, tagText - counterText - 2, counter)) return false;
+
+    for (int i = 0; i < TAG_BYTES; ++i) {
+        uint32_t byte;
+        if (!parseHex(tagText + 2 * i, 2, byte)) return false;
+        tag[i] = byte;
+    }
+    return true;
+}
+
+bool FrameAuth::open(char* frame) {
+    // Every frame that isn't accepted counts as rejected, malformed ones too
+    char* counterText = NULL;
+    uint32_t counter = 0;
+    uint8_t received[TAG_BYTES];
+    bool ok = _hasKey && parseTrailer(frame, counterText, counter, received);
+    if (_mutex == NULL) {
+        _rejected++;  // Neither begin() nor a key yet, nothing else to guard
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (ok) {
+        uint8_t expected[TAG_BYTES];
+        computeTag(_rxDirection, counter, frame, counterText - frame, expected);
+
+        // Compare without an early exit so timing does not leak the tag
+        uint8_t diff = 0;
+        for (int i = 0; i < TAG_BYTES; ++i) diff |= received[i] ^ expected[i];
+        ok = diff == 0 && counter > _rxLast;
+    }
+    if (ok) {
+        // Only a frame past the stored bound moves it, a reboot must not
+        // reopen the replay window
+        _rxLast = counter;
+        if (_persistent && _rxLast > _rxReserved) {
+            _rxReserved = _rxLast + RX_BLOCK;
+            _prefs.putUInt(NVS_KEY_RX, _rxReserved);
+        }
+    } else {
+        _rejected++;
+    }
+    xSemaphoreGive(_mutex);
+
+    if (ok) *counterText = '\0';
+    return ok;
+}
+
+uint32_t FrameAuth::rejectedFrames() const {
+    return _rejected;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <mbedtls/cipher.h>
+
+// Authenticated LoRa frames. A sealed frame is the text payload followed by
+// "|<counter>|<tag>" in hex: the counter never repeats per direction, so a
+// recorded frame cannot be played back, and the tag is the AES-128-CMAC of
+// direction, counter and payload truncated to 4 bytes. AES runs on the
+// ESP32's hardware engine through mbedTLS.
+class FrameAuth {
+public:
+    static constexpr int KEY_BYTES = 16;
+    static constexpr int TAG_BYTES = 4;
+    // Most seal() adds: two separators, an 8 digit counter and the tag
+    static constexpr int OVERHEAD = 2 + 8 + 2 * TAG_BYTES;
+
+    // The direction letters tell the two ends apart ('R' remote, 'M' motor),
+    // so a device never accepts its own frames reflected back at it.
+    FrameAuth(char txDirection, char rxDirection);
+
+    bool begin();  // Loads the key and both counters from NVS
+    bool hasKey() const;
+    // Stores a new key (32 hex digits) and restarts both counters.
+    // Provision both devices with the same key.
+    bool provisionKey(const char* hex);
+    // Uses a key without touching NVS, for benchmarks
+    bool setKey(const uint8_t* key);
+
+    // Appends counter and tag in place; false without a key or room
+    bool seal(char* frame, size_t size);
+    // Verifies and strips counter and tag; false on a malformed frame, a bad
+    // tag or a replay, all counted in rejectedFrames()
+    bool open(char* frame);
+
+    uint32_t rejectedFrames() const;
+
+private:
+    bool parseTrailer(char* frame, char*& counterText, uint32_t& counter, uint8_t* tag);
+    void computeTag(char direction, uint32_t counter, const char* payload, size_t len, uint8_t* tag);
+
+    char _txDirection;
+    char _rxDirection;
+    Preferences _prefs;  // Kept open, opening NVS allocates
+    bool _persistent;
+    mbedtls_cipher_context_t _cipher;
+    bool _hasKey;
+    uint32_t _txCounter;
+    uint32_t _txReserved;  // Counters below this are already stored as used
+    uint32_t _rxLast;
+    uint32_t _rxReserved;  // Counters up to this are stored as seen
+    uint32_t _rejected;
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+};
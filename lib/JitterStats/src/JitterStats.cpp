@@ -0,0 +1,44 @@
+#include "JitterStats.h"
+
+JitterStats::JitterStats(const char* name, uint32_t periodUs)
+    : _name(name), _periodUs(periodUs), _lastUs(-1), _lastReportMs(0) {
+    reset();
+}
+
+void JitterStats::reset() {
+    _minUs = UINT32_MAX;
+    _maxUs = 0;
+    _samples = 0;
+}
+
+void JitterStats::restart() {
+    _lastUs = -1;
+}
+
+void JitterStats::setPeriod(uint32_t periodUs) {
+    _periodUs = periodUs;
+    reset();
+    restart();
+}
+
+void JitterStats::tick() {
+#ifdef JITTER_REPORT
+    int64_t now = esp_timer_get_time();
+    if (_lastUs >= 0) {
+        uint32_t interval = (uint32_t)(now - _lastUs);
+        if (interval < _minUs) _minUs = interval;
+        if (interval > _maxUs) _maxUs = interval;
+        _samples++;
+    }
+    _lastUs = now;
+
+    if (_samples > 0 && millis() - _lastReportMs >= REPORT_INTERVAL_MS) {
+        uint32_t early = (_minUs < _periodUs) ? _periodUs - _minUs : 0;
+        uint32_t late = (_maxUs > _periodUs) ? _maxUs - _periodUs : 0;
+        Serial.printf("[Jitter] %s: period %u us, min %u, max %u, worst %u us (%u samples, core %d)\n",
+                      _name, _periodUs, _minUs, _maxUs, max(early, late), _samples, xPortGetCoreID());
+        _lastReportMs = millis();
+        reset();
+    }
+#endif
+}
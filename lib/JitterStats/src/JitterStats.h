@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Measures how far a periodic activity strays from its nominal period.
+// Build with -DJITTER_REPORT to get a min/max/worst-deviation line per
+// activity on Serial every REPORT_INTERVAL_MS; otherwise tick() is free.
+class JitterStats {
+public:
+    static constexpr uint32_t REPORT_INTERVAL_MS = 60000;
+
+    JitterStats(const char* name, uint32_t periodUs);
+
+    void tick();     // Call once per period
+    void restart();  // Call after a deliberate pause
+    void setPeriod(uint32_t periodUs);  // Restarts with a new nominal period
+
+private:
+    void reset();
+
+    const char* _name;
+    uint32_t _periodUs;
+    int64_t _lastUs;
+    uint32_t _minUs;
+    uint32_t _maxUs;
+    uint32_t _samples;
+    unsigned long _lastReportMs;
+};
@@ -0,0 +1,127 @@
+#include "LoRaProtocol.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+int formatValveCommand(char* buffer, size_t size, float valvePercent) {
+    return snprintf(buffer, size, "VALVE:%.2f", valvePercent);
+}
+
+// The supply temperature is left out when there is no supply sensor
+int formatControlReport(char* buffer, size_t size, float targetTemp, float roomTemp, float supplyTemp) {
+    if (isnan(supplyTemp)) return snprintf(buffer, size, "CTRL:%.1f,%.2f", targetTemp, roomTemp);
+    return snprintf(buffer, size, "CTRL:%.1f,%.2f,%.2f", targetTemp, roomTemp, supplyTemp);
+}
+
+static bool startsWith(const char* text, const char* prefix) {
+    return strncasecmp(text, prefix, strlen(prefix)) == 0;
+}
+
+// Reads a number and requires the separator (or end of payload) after it.
+// A separator of ',' also accepts the end of the payload, see hasMore().
+static bool readFloat(const char*& p, char separator, float& value) {
+    char* end;
+    value = strtof(p, &end);
+    if (end == p) return false;
+    while (isspace((unsigned char)*end)) end++;
+    if (*end != separator && !(separator == ',' && *end == '\0')) return false;
+    p = (*end == '\0') ? end : end + 1;
+    return true;
+}
+
+static bool hasMore(const char* p) {
+    return *p != '\0';
+}
+
+// Optional "@<axis>" right after a keyword
+static bool readAxis(const char*& p, int& axis) {
+    axis = LoRaCommand::ALL_AXES;
+    if (*p != '@') return true;
+    if (p[1] < '0' || p[1] >= '0' + LoRaCommand::MAX_AXES) return false;
+    axis = p[1] - '0';
+    p += 2;
+    return true;
+}
+
+// Keyword, optional axis and the ':' before the arguments
+static bool readHeader(const char*& p, const char* keyword, int& axis) {
+    if (!startsWith(p, keyword)) return false;
+    const char* q = p + strlen(keyword);
+    if (!readAxis(q, axis) || *q != ':') return false;
+    p = q + 1;
+    return true;
+}
+
+bool LoRaCommand::parse(const char* payload, LoRaCommand& command) {
+    while (isspace((unsigned char)*payload)) payload++;
+    command.type = NONE;
+    command.axis = ALL_AXES;
+    const char* p = payload;
+
+    if (readHeader(p, "VALVE", command.axis)) {
+        float value;
+        if (!readFloat(p, '\0', value)) return false;
+        if (value < 0.0f || value > 100.0f) return false;
+        command.valvePercent = value;
+        command.type = VALVE;
+    } else if (startsWith(payload, "CTRL:")) {
+        p = payload + 5;
+        float setpoint, roomTemp, supplyTemp = NAN;
+        if (!readFloat(p, ',', setpoint) || !hasMore(p) || !readFloat(p, ',', roomTemp)) return false;
+        if (hasMore(p) && !readFloat(p, '\0', supplyTemp)) return false;
+        command.setpoint = setpoint;
+        command.roomTemp = roomTemp;
+        command.supplyTemp = supplyTemp;
+        command.type = CTRL;
+    } else if (startsWith(payload, "CAL")) {
+        p = payload + 3;
+        if (!readAxis(p, command.axis)) return false;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p != '\0') return false;
+        command.type = CALIBRATE;
+    } else if (readHeader(p, "CURVE", command.axis)) {
+        for (int i = 0; i < CURVE_POINTS; ++i) {
+            float value;
+            bool last = (i == CURVE_POINTS - 1);
+            if (!readFloat(p, last ? '\0' : ',', value)) return false;
+            if (!last && !hasMore(p)) return false;
+            if (value < 0.0f || value > 100.0f) return false;
+            command.curve[i] = (uint8_t)value;
+        }
+        command.type = CURVE;
+    }
+
+    return command.type != NONE;
+}
+
+int StatusReport::format(char* buffer, size_t size) const {
+    int n = (axis > 0) ? snprintf(buffer, size, "STAT@%d:", axis) : snprintf(buffer, size, "STAT:");
+    if (n < 0 || (size_t)n >= size) return n;
+    return n + snprintf(buffer + n, size - n, "%d,%d,%d,%d,%d,%.1f,%d,%lu,%d",
+                        actualPercent, targetPercent, stalled ? 1 : 0,
+                        peakCurrent_mA, rssi, snr, moveEnergy_mJ,
+                        (unsigned long)totalEnergy_J, seizing ? 1 : 0);
+}
+
+bool ActuatorStatus::parse(const char* payload, ActuatorStatus& status) {
+    int stall = 0, seizing = 0, consumed = 0;
+    status.axis = 0;
+    if (sscanf(payload, "STAT@%d:%n", &status.axis, &consumed) == 1 && consumed > 0) {
+        if (status.axis < 0 || status.axis >= ActuatorStatus::MAX_AXES) return false;
+        payload += consumed;
+    } else if (strncmp(payload, "STAT:", 5) == 0) {
+        payload += 5;
+    } else {
+        return false;
+    }
+    int fields = sscanf(payload, "%d,%d,%d,%d,%d,%f,%d,%lu,%d",
+                        &status.actualPercent, &status.targetPercent, &stall,
+                        &status.peakCurrent_mA, &status.rssi, &status.snr,
+                        &status.moveEnergy_mJ, &status.totalEnergy_J, &seizing);
+    status.stalled = (stall != 0);
+    status.seizing = (seizing != 0);
+    return fields == 6 || fields == 9;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Both ends of the LoRa link between the remote and the motor controller.
+// Each side builds the whole codec and uses its half.
+
+// Remote: frames sent to the motor controller
+int formatValveCommand(char* buffer, size_t size, float valvePercent);
+int formatControlReport(char* buffer, size_t size, float targetTemp, float roomTemp, float supplyTemp);
+
+// Motor controller: commands from the remote. Keywords are case-insensitive.
+// VALVE, CAL and CURVE take an optional "@<axis>" after the keyword to
+// address one valve drive ("VALVE@2:40"); without it they apply to every
+// valve.
+//   VALVE:<percent>             set valve opening directly
+//   CTRL:<setpoint>,<room temp>[,<supply temp>]
+//                               run the valve loop locally, for every valve
+//   CAL                         run the calibration sweep
+//   CURVE:p0,...,p10            upload a valve characteristic
+struct LoRaCommand {
+    enum Type { NONE, VALVE, CTRL, CALIBRATE, CURVE };
+    static constexpr int MAX_AXES = 4;  // TMC2209 UART addresses
+    static constexpr int ALL_AXES = -1;
+    static constexpr int CURVE_POINTS = 11;  // ValveCharacteristic::POINTS
+
+    Type type = NONE;
+    int axis = ALL_AXES;
+    float valvePercent = 0.0f;
+    float setpoint = 0.0f;
+    float roomTemp = 0.0f;
+    float supplyTemp = 0.0f;     // NAN when the remote has no supply sensor
+    uint8_t curve[CURVE_POINTS];
+
+    static bool parse(const char* payload, LoRaCommand& command);
+};
+
+// Motor controller: status frame sent back after each move, "STAT@<axis>:"
+// for axes above 0:
+// "STAT:<actual %>,<target %>,<stall>,<peak mA>,<rssi>,<snr>,<move mJ>,<total J>,<seizing>"
+struct StatusReport {
+    int axis = 0;
+    int actualPercent = 0;
+    int targetPercent = 0;
+    bool stalled = false;
+    int peakCurrent_mA = 0;
+    int rssi = 0;
+    float snr = 0.0f;
+    int moveEnergy_mJ = 0;
+    uint32_t totalEnergy_J = 0;
+    bool seizing = false;
+
+    int format(char* buffer, size_t size) const;
+};
+
+// Remote: the status frame as received, older firmware sends only the first
+// six fields
+struct ActuatorStatus {
+    static constexpr int MAX_AXES = 4;
+
+    int axis = 0;       // Valve drive on a multi-valve controller
+    int actualPercent = 0;
+    int targetPercent = 0;
+    bool stalled = false;
+    int peakCurrent_mA = 0;
+    int rssi = 0;       // Our last command as seen by the actuator
+    float snr = 0.0f;
+    int moveEnergy_mJ = 0;   // Energy fields stay 0 from older firmware
+    unsigned long totalEnergy_J = 0;
+    bool seizing = false;
+
+    static bool parse(const char* payload, ActuatorStatus& status);
+};
@@ -0,0 +1,82 @@
+#include "MemoryGuard.h"
+#include <esp_rom_sys.h>
+
+static TaskHandle_t tasks[MemoryGuard::MAX_TASKS];
+static uint32_t stackSizes[MemoryGuard::MAX_TASKS];
+static const char* stackDefines[MemoryGuard::MAX_TASKS];
+static int taskCount = 0;
+static volatile bool heapLocked = false;
+static volatile uint32_t violations = 0;
+
+void MemoryGuard::registerTask(TaskHandle_t task, uint32_t stackBytes, const char* stackDefine) {
+    if (task == NULL || taskCount >= MAX_TASKS) return;
+    tasks[taskCount] = task;
+    stackSizes[taskCount] = stackBytes;
+    stackDefines[taskCount] = stackDefine;
+    taskCount++;
+}
+
+void MemoryGuard::lockHeap() {
+    heapLocked = true;
+}
+
+uint32_t MemoryGuard::heapViolations() {
+    return violations;
+}
+
+static uint32_t suggestedStack(int task) {
+    // The high-water mark is in bytes on the ESP32, as are the sizes
+    uint32_t peak = stackSizes[task] - uxTaskGetStackHighWaterMark(tasks[task]);
+    return (peak + peak / 4 + 255) / 256 * 256;
+}
+
+void MemoryGuard::printReport(Print& out) {
+    char line[64];
+    out.println("Task             stack   peak  unused  suggested [bytes]");
+    for (int i = 0; i < taskCount; ++i) {
+        uint32_t unused = uxTaskGetStackHighWaterMark(tasks[i]);
+        snprintf(line, sizeof(line), "%-16s %5u  %5u   %5u      %5u", pcTaskGetTaskName(tasks[i]),
+                 (unsigned)stackSizes[i], (unsigned)(stackSizes[i] - unused), (unsigned)unused,
+                 (unsigned)suggestedStack(i));
+        out.println(line);
+    }
+    for (int i = 0; i < taskCount; ++i) {
+        snprintf(line, sizeof(line), "#define %-20s %u", stackDefines[i], (unsigned)suggestedStack(i));
+        out.println(line);
+    }
+
+    snprintf(line, sizeof(line), "Free heap %u, allocations after setup %u",
+             (unsigned)ESP.getFreeHeap(), (unsigned)violations);
+    out.println(line);
+}
+
+#ifdef STATIC_ALLOCATION
+// Linked in with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc. Only the ROM
+// printf is safe here, Serial may allocate itself.
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static void noteAllocation(size_t size, void* caller) {
+    if (!heapLocked) return;
+    violations = violations + 1;
+    esp_rom_printf("[MemoryGuard] %u bytes allocated after setup() from %p\n", (unsigned)size, caller);
+}
+
+void* __wrap_malloc(size_t size) {
+    noteAllocation(size, __builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    noteAllocation(count * size, __builtin_return_address(0));
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    noteAllocation(size, __builtin_return_address(0));
+    return __real_realloc(ptr, size);
+}
+}
+#endif
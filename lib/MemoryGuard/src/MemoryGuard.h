@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Support for the zero-heap build (-DSTATIC_ALLOCATION, the *-static envs).
+// malloc/calloc/realloc are wrapped at link time; after lockHeap() every
+// allocation is counted and logged with its caller. Tasks created through
+// CREATE_TASK (TaskLayout.h) are listed with their stack size, the peak use
+// since boot and a suggested size: the peak plus a quarter, rounded up to
+// 256 bytes. The report ends with the suggestions as STACK_ defines, to be
+// pasted into TaskLayout.h after a run that exercised every path
+// (calibration, NVS writes, radio traffic).
+class MemoryGuard {
+public:
+    static constexpr int MAX_TASKS = 10;
+
+    // stackDefine names the size's define, CREATE_TASK passes it
+    static void registerTask(TaskHandle_t task, uint32_t stackBytes, const char* stackDefine);
+    static void lockHeap();     // Call at the end of setup()
+    static uint32_t heapViolations();
+
+    static void printReport(Print& out);
+};
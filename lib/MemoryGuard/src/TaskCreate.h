@@ -0,0 +1,39 @@
+#pragma once
+
+#include "MemoryGuard.h"
+
+// Task creation for both firmwares. Each project's TaskLayout.h holds its
+// core, priority and stack plan and includes this for CREATE_TASK, which
+// registers every task with MemoryGuard for the MEM report.
+
+// -DUNPINNED_TASKS ignores the plan and creates every task the way it was
+// before, at priority 1 on whichever core is free. Same code otherwise, so
+// the JITTER_REPORT lines of the two builds compare the layouts alone.
+#ifdef UNPINNED_TASKS
+#define TASK_PRIO(prio) 1
+#define TASK_CORE(core) tskNO_AFFINITY
+#else
+#define TASK_PRIO(prio) (prio)
+#define TASK_CORE(core) (core)
+#endif
+
+// The zero-heap build gives every task a static stack and control block
+// instead of allocating them.
+#ifdef STATIC_ALLOCATION
+#define CREATE_TASK(fn, name, stackBytes, prio, core)                                     \
+    do {                                                                                    \
+        static StackType_t fn##Stack[stackBytes];                                           \
+        static StaticTask_t fn##Tcb;                                                        \
+        MemoryGuard::registerTask(xTaskCreateStaticPinnedToCore(fn, name, stackBytes, NULL, \
+                                  TASK_PRIO(prio), fn##Stack, &fn##Tcb, TASK_CORE(core)),   \
+                                  stackBytes, #stackBytes);                                 \
+    } while (0)
+#else
+#define CREATE_TASK(fn, name, stackBytes, prio, core)                                 \
+    do {                                                                              \
+        TaskHandle_t handle = NULL;                                                   \
+        xTaskCreatePinnedToCore(fn, name, stackBytes, NULL, TASK_PRIO(prio), &handle, \
+                                TASK_CORE(core));                                     \
+        MemoryGuard::registerTask(handle, stackBytes, #stackBytes);                   \
+    } while (0)
+#endif
@@ -0,0 +1,88 @@
+#include "ValveController.h"
+#include <algorithm>
+#include <cmath>
+
+ValveController::ValveController()
+    : _valvePosition(0), _stallHoldCycles(0), _stepSize(SMALL_STEP), _historyStart(0), _historyCount(0) {}
+
+void ValveController::setValvePosition(int position) {
+    if (position > MAX_VALVE) position = MAX_VALVE;
+    else if (position < MIN_VALVE) position = MIN_VALVE;
+    _valvePosition = position;
+}
+
+int ValveController::getValvePosition() {
+    return _valvePosition;
+}
+
+void ValveController::recordTemperature(float temp) {
+    if (_historyCount < MAX_HISTORY) {
+        _tempHistory[(_historyStart + _historyCount) % MAX_HISTORY] = temp;
+        _historyCount++;
+    } else {
+        _tempHistory[_historyStart] = temp;
+        _historyStart = (_historyStart + 1) % MAX_HISTORY;
+    }
+}
+
+// The actuator reports where the valve really is. After a stall the commanded
+// position was never reached, so continue from the confirmed one.
+void ValveController::applyActuatorStatus(int actualPosition, bool stalled) {
+    if (!stalled) return;
+    setValvePosition(actualPosition);
+    _stallHoldCycles = STALL_HOLD_CYCLES;
+}
+
+void ValveController::setStepSize(int percent) {
+    _stepSize = percent < 1 ? 1 : percent;
+}
+
+bool ValveController::isWithinDeadband(float current, float target) {
+    return std::fabs(current - target) <= DEAD_BAND;
+}
+
+float ValveController::calculateTrend() {
+    if (_historyCount < 2) return 0.0f;
+    float oldest = _tempHistory[_historyStart];
+    float newest = _tempHistory[(_historyStart + _historyCount - 1) % MAX_HISTORY];
+    return (newest - oldest) / (_historyCount - 1);
+}
+
+void ValveController::openValve(int percent) {
+    setValvePosition(_valvePosition + percent);
+}
+
+void ValveController::closeValve(int percent) {
+    setValvePosition(_valvePosition - percent);
+}
+
+void ValveController::update(float currentTemp, float targetTemp) {
+    update(currentTemp, targetTemp, NAN);
+}
+
+void ValveController::update(float currentTemp, float targetTemp, float supplyTemp) {
+    if (_stallHoldCycles > 0) {
+        _stallHoldCycles--;
+        return;
+    }
+    if (isWithinDeadband(currentTemp, targetTemp)) return;
+
+    float trend = calculateTrend();
+
+    // The supply pipe warms up long before the room does. While the radiator
+    // is hot the heat is already on its way, so a slow room trend is no
+    // reason to open further.
+    bool radiatorHot = !std::isnan(supplyTemp) && supplyTemp - currentTemp > SUPPLY_HOT_DELTA;
+
+    if (targetTemp > currentTemp) {
+        if (_valvePosition >= MAX_VALVE) return;
+        if (_valvePosition == 0) openValve(_stepSize);
+        else if (trend < MIN_WARMING_RATE && !radiatorHot) openValve(_stepSize);
+        else if (trend > MAX_WARMING_RATE) closeValve(_stepSize);
+    } else {
+        if (_valvePosition <= MIN_VALVE) return;
+        if (_valvePosition == MAX_VALVE) closeValve(_stepSize);
+        else if (trend > MIN_COOLING_RATE) closeValve(_stepSize);
+        else if (trend < MAX_COOLING_RATE && !radiatorHot) openValve(_stepSize);
+    }
+}
@@ -1,14 +1,17 @@
 #pragma once
-#include <vector>
+#include <stddef.h>
 
 class ValveController {
 public:
     ValveController();
 
     void update(float currentTemp, float targetTemp);
+    void update(float currentTemp, float targetTemp, float supplyTemp);  // NAN = no supply sensor
     void setValvePosition(int position); // 0 - 100%
     int getValvePosition();
     void recordTemperature(float temp);
+    void applyActuatorStatus(int actualPosition, bool stalled);
+    void setStepSize(int percent);  // Valve change per update, SMALL_STEP by default
 
 private:
     void openValve(int percent);
@@ -16,17 +19,25 @@ private:
     float calculateTrend();
     bool isWithinDeadband(float current, float target);
 
+    static constexpr size_t MAX_HISTORY = 5;
+
     int _valvePosition;
-    std::vector<float> _tempHistory;
+    int _stallHoldCycles;
+    int _stepSize;
+    float _tempHistory[MAX_HISTORY];  // Ring buffer, oldest at _historyStart
+    size_t _historyStart;
+    size_t _historyCount;
 
     static constexpr float DEAD_BAND = 0.2f;
     static constexpr int SMALL_STEP = 5;
     static constexpr int MAX_VALVE = 100;
     static constexpr int MIN_VALVE = 0;
-    static constexpr size_t MAX_HISTORY = 5;
+    static constexpr int STALL_HOLD_CYCLES = 6;  // Don't push a stalled valve for 6 updates
 
     static constexpr float MIN_WARMING_RATE = 0.05f;
     static constexpr float MAX_WARMING_RATE = 0.3f;
     static constexpr float MIN_COOLING_RATE = -0.05f;
     static constexpr float MAX_COOLING_RATE = -0.3f;
+
+    static constexpr float SUPPLY_HOT_DELTA = 10.0f;  // Radiator clearly heating
 };
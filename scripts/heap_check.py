@@ -0,0 +1,64 @@
+# Post-build check for the zero-heap env: fails the build when one of our own
+# object files calls into the heap or creates a dynamically allocated RTOS
+# object. Our own means the project's src/ and the shared libraries in its
+# lib_extra_dirs (../lib); third-party library code is covered at runtime by
+# MemoryGuard instead.
+#   extra_scripts = post:<path to this file>
+import glob
+import os
+import subprocess
+
+Import("env")
+
+FORBIDDEN = (
+    "malloc", "calloc", "realloc",
+    "_Znwj", "_Znaj",                           # operator new / new[]
+    "xTaskCreatePinnedToCore", "xTaskCreate",
+    "xQueueGenericCreate", "xQueueCreateMutex",
+)
+
+
+def is_forbidden(symbol):
+    return symbol in FORBIDDEN or symbol.startswith("_ZN6String")
+
+
+def shared_libraries(env):
+    dirs = env.GetProjectOption("lib_extra_dirs", [])
+    if isinstance(dirs, str):
+        dirs = dirs.split()
+    names = []
+    for d in dirs:
+        d = os.path.join(env.subst("$PROJECT_DIR"), d)
+        names += [n for n in os.listdir(d) if os.path.isdir(os.path.join(d, n))]
+    return names
+
+
+def own_objects(env):
+    build_dir = env.subst("$BUILD_DIR")
+    objects = glob.glob(os.path.join(build_dir, "src", "**", "*.o"), recursive=True)
+    # Libraries are built to lib<hash>/<name>/
+    for name in shared_libraries(env):
+        objects += glob.glob(os.path.join(build_dir, "lib*", name, "**", "*.o"), recursive=True)
+    return objects
+
+
+def check_heap(source, target, env):
+    nm = env.subst("$CC").replace("gcc", "nm")
+    objects = own_objects(env)
+    failures = []
+    for obj in sorted(objects):
+        output = subprocess.check_output([nm, "-u", obj]).decode()
+        for line in output.splitlines():
+            symbol = line.split()[-1]
+            if is_forbidden(symbol):
+                failures.append("%s: %s" % (os.path.basename(obj), symbol))
+
+    if failures:
+        print("Heap use in the zero-heap build:")
+        for failure in failures:
+            print("  " + failure)
+        env.Exit(1)
+    print("Heap check passed for %d object files" % len(objects))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_heap)
@@ -0,0 +1,61 @@
+#include "Activity.h"
+
+Activity::Activity(const char* name)
+    : _resume(0), _name(name), _next(nullptr), _nowMs(0), _wakeMs(0), _timed(false), _finished(false),
+      _waiting(0), _woken(0), _runs(0) {}
+
+void Activity::sleepUntil(uint32_t ms) {
+    _wakeMs = ms;
+    _timed = true;
+    _waiting = 0;
+}
+
+void Activity::waitFor(ActivityEvents events, uint32_t timeoutMs) {
+    _wakeMs = _nowMs + timeoutMs;
+    _timed = timeoutMs != FOREVER;
+    _waiting = events;
+}
+
+void Activity::finish() {
+    _finished = true;
+    _timed = false;
+    _waiting = 0;
+}
+
+ActivityScheduler::ActivityScheduler() : _first(nullptr), _last(nullptr), _pending(0) {}
+
+void ActivityScheduler::add(Activity& activity) {
+    if (_last) _last->_next = &activity;
+    else _first = &activity;
+    _last = &activity;
+}
+
+uint32_t ActivityScheduler::runReady(uint32_t nowMs) {
+    // Events signalled while the activities run carry over to the next pass
+    ActivityEvents pending = _pending.exchange(0);
+
+    for (Activity* a = _first; a; a = a->_next) {
+        if (a->_finished) continue;
+        ActivityEvents woken = a->_waiting & pending;
+        bool due = a->_timed && (int32_t)(nowMs - a->_wakeMs) >= 0;
+        if (a->_resume != 0 && !woken && !due) continue;
+
+        a->_nowMs = nowMs;
+        a->_woken = woken;
+        a->_timed = false;
+        a->_waiting = 0;
+        a->_runs++;
+        a->step();
+    }
+
+    if (_pending.load() != 0) return 0;
+
+    uint32_t next = Activity::FOREVER;
+    for (Activity* a = _first; a; a = a->_next) {
+        if (a->_finished || !a->_timed) continue;
+        int32_t left = (int32_t)(a->_wakeMs - nowMs);
+        if (left <= 0) return 0;
+        if ((uint32_t)left < next) next = left;
+    }
+    return next;
+}
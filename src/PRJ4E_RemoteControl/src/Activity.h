@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Stackless cooperative activities, all run from one FreeRTOS task (see
+// ActivityTask.h). An activity is an object whose step() body resumes where
+// it last waited, in the style of protothreads: a wait macro records the
+// line and returns, and the next run jumps back there through the switch
+// opened by ACTIVITY_BEGIN. State that has to survive a wait lives in
+// members, so an activity costs a few dozen bytes instead of a task stack.
+//
+// Rules that come with the switch:
+// - locals must not be declared in a scope that a later wait shares; put
+//   the work between waits in a helper or a braced block
+// - no wait inside a switch statement of the body, one wait per line
+//
+// The scheduler runs activities in the order they were added, each until
+// its next wait, so one that blocks (a flash write, a radio transfer) holds
+// the others back by that long. Time is passed in by the caller, which keeps
+// this file free of Arduino and FreeRTOS for the host tests.
+typedef uint32_t ActivityEvents;  // One bit per event source
+
+class Activity {
+public:
+    static constexpr uint32_t FOREVER = 0xFFFFFFFF;
+
+    explicit Activity(const char* name);
+
+    const char* name() const { return _name; }
+    const Activity* next() const { return _next; }
+    bool finished() const { return _finished; }
+    uint32_t runs() const { return _runs; }
+
+protected:
+    // The body between ACTIVITY_BEGIN() and ACTIVITY_END()
+    virtual void step() = 0;
+
+    uint32_t now() const { return _nowMs; }          // Start of this scheduler pass [ms]
+    ActivityEvents woken() const { return _woken; }  // Events that ended the last wait, 0 on timeout
+
+    // Used by the macros below
+    void sleepUntil(uint32_t ms);
+    void waitFor(ActivityEvents events, uint32_t timeoutMs);
+    void finish();
+    uint16_t _resume;  // Line of the last wait, 0 before the first run
+
+private:
+    friend class ActivityScheduler;
+
+    const char* _name;
+    Activity* _next;
+    uint32_t _nowMs;
+    uint32_t _wakeMs;
+    bool _timed;
+    bool _finished;
+    ActivityEvents _waiting;
+    ActivityEvents _woken;
+    uint32_t _runs;
+};
+
+#define ACTIVITY_BEGIN() switch (_resume) { case 0:
+#define ACTIVITY_END() } finish()
+
+#define ACTIVITY_SUSPEND_() _resume = __LINE__; return; case __LINE__:;
+
+// Resumes after ms, or at an absolute time for drift-free periods
+#define ACTIVITY_SLEEP(ms) do { sleepUntil(now() + (ms)); ACTIVITY_SUSPEND_(); } while (0)
+#define ACTIVITY_SLEEP_UNTIL(ms) do { sleepUntil(ms); ACTIVITY_SUSPEND_(); } while (0)
+
+// Resumes when one of the events is signalled or after timeoutMs
+// (Activity::FOREVER for none); woken() tells which
+#define ACTIVITY_WAIT(events, timeoutMs) do { waitFor(events, timeoutMs); ACTIVITY_SUSPEND_(); } while (0)
+
+class ActivityScheduler {
+public:
+    ActivityScheduler();
+
+    // Before the first run; activities are never removed
+    void add(Activity& activity);
+    const Activity* first() const { return _first; }
+
+    // From any task or interrupt. Wakes the activities waiting for one of
+    // the events; an event nobody waits for is dropped, it is an edge and
+    // not a count.
+    void signal(ActivityEvents events) { _pending.fetch_or(events); }
+
+    // Runs every activity whose timer is due at nowMs or whose event was
+    // signalled, once each. Returns the ms until the next timer or 0 when an
+    // event came in meanwhile, FOREVER if only an event can wake one.
+    uint32_t runReady(uint32_t nowMs);
+
+private:
+    Activity* _first;
+    Activity* _last;
+    std::atomic<uint32_t> _pending;
+};
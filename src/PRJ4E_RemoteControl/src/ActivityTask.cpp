@@ -0,0 +1,25 @@
+#include "ActivityTask.h"
+
+ActivityTask::ActivityTask() : _task(NULL) {}
+
+void ActivityTask::run() {
+    _task = xTaskGetCurrentTaskHandle();
+    for (;;) {
+        uint32_t waitMs = runReady(millis());
+        // Signals that arrived during the pass have already notified us
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs < MAX_WAIT_MS ? waitMs : MAX_WAIT_MS));
+    }
+}
+
+void ActivityTask::signal(ActivityEvents events) {
+    ActivityScheduler::signal(events);
+    if (_task != NULL) xTaskNotifyGive(_task);
+}
+
+void IRAM_ATTR ActivityTask::signalFromISR(ActivityEvents events) {
+    ActivityScheduler::signal(events);
+    if (_task == NULL) return;
+    BaseType_t higherPriorityWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(_task, &higherPriorityWoken);
+    if (higherPriorityWoken) portYIELD_FROM_ISR();
+}
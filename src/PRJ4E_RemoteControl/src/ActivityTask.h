@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Activity.h"
+
+// Runs an ActivityScheduler as the body of one FreeRTOS task. Between
+// passes the task blocks on its notification until the next timer is due;
+// signal() and signalFromISR() notify it so a waiting activity runs without
+// delay.
+class ActivityTask : public ActivityScheduler {
+public:
+    ActivityTask();
+
+    // Task body, never returns
+    void run();
+
+    void signal(ActivityEvents events);
+    void IRAM_ATTR signalFromISR(ActivityEvents events);
+
+private:
+    static constexpr uint32_t MAX_WAIT_MS = 60000;  // Keeps pdMS_TO_TICKS in range
+
+    TaskHandle_t _task;
+};
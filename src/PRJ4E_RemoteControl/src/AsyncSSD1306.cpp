@@ -0,0 +1,237 @@
+#include "AsyncSSD1306.h"
+#include <esp_timer.h>
+#include <string.h>
+
+static const uint8_t CONTROL_COMMAND = 0x00;
+static const uint8_t CONTROL_DATA = 0x40;
+
+// Page and column addressing as sent by U8g2 before every tile row
+static bool isAddressing(uint8_t cmd) {
+    return cmd <= 0x1F || (cmd >= 0xB0 && cmd <= 0xB7);
+}
+
+AsyncSSD1306::AsyncSSD1306(const u8g2_cb_t* rotation)
+    : _port(I2C_NUM_0), _flushTask(NULL), _control(CONTROL_COMMAND), _controlSeen(false), _commandLen(0),
+      _page(0), _column(0), _pendingLen(0), _lastFlushUs(0), _maxFlushUs(0), _flushCount(0),
+      _failedFlushes(0) {
+    u8g2_Setup_ssd1306_i2c_128x64_noname_f(&u8g2, rotation, byteCallback, u8x8_gpio_and_delay_arduino);
+    u8x8_SetUserPtr(u8g2_GetU8x8(&u8g2), this);
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+
+    // Panel RAM is random after power-up, so the first flush sends everything
+    memset(_shadow, 0, sizeof(_shadow));
+    for (int p = 0; p < PAGES; ++p) {
+        _dirtyFrom[p] = 0;
+        _dirtyTo[p] = COLUMNS - 1;
+    }
+}
+
+bool AsyncSSD1306::beginBus(int sda, int scl, uint32_t clockHz) {
+    i2c_config_t config = {};
+    config.mode = I2C_MODE_MASTER;
+    config.sda_io_num = sda;
+    config.scl_io_num = scl;
+    config.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    config.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    config.master.clk_speed = clockHz;
+    if (i2c_param_config(_port, &config) != ESP_OK) return false;
+    return i2c_driver_install(_port, I2C_MODE_MASTER, 0, 0, 0) == ESP_OK;
+}
+
+uint8_t AsyncSSD1306::byteCallback(u8x8_t* u8x8, uint8_t msg, uint8_t argInt, void* argPtr) {
+    AsyncSSD1306* self = static_cast<AsyncSSD1306*>(u8x8_GetUserPtr(u8x8));
+    switch (msg) {
+        case U8X8_MSG_BYTE_START_TRANSFER:
+            self->startTransfer();
+            break;
+        case U8X8_MSG_BYTE_SEND:
+            self->sendBytes(static_cast<const uint8_t*>(argPtr), argInt);
+            break;
+        case U8X8_MSG_BYTE_END_TRANSFER:
+            self->endTransfer();
+            break;
+        case U8X8_MSG_BYTE_INIT:  // Bus is set up in beginBus()
+        case U8X8_MSG_BYTE_SET_DC:
+            break;
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+// Held for the length of one U8g2 transfer (a few dozen bytes), never
+// across bus traffic
+void AsyncSSD1306::startTransfer() {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _controlSeen = false;
+    _commandLen = 0;
+}
+
+void AsyncSSD1306::sendBytes(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t b = data[i];
+        if (!_controlSeen) {
+            _control = b;
+            _controlSeen = true;
+            continue;
+        }
+
+        if (_control == CONTROL_DATA) {
+            if (_shadow[_page][_column] != b) {
+                _shadow[_page][_column] = b;
+                if (_dirtyFrom[_page] > _dirtyTo[_page]) {
+                    _dirtyFrom[_page] = _dirtyTo[_page] = _column;
+                } else if (_column < _dirtyFrom[_page]) {
+                    _dirtyFrom[_page] = _column;
+                } else if (_column > _dirtyTo[_page]) {
+                    _dirtyTo[_page] = _column;
+                }
+            }
+            _column = (_column + 1) % COLUMNS;  // Page addressing wraps within the page
+            continue;
+        }
+
+        if (_commandLen == MAX_COMMANDS) {
+            // Only init sequences get this long, pass the first part on as is
+            if (_pendingLen + _commandLen <= MAX_COMMANDS) {
+                memcpy(_pending + _pendingLen, _command, _commandLen);
+                _pendingLen += _commandLen;
+            }
+            _commandLen = 0;
+        }
+        _command[_commandLen++] = b;
+    }
+}
+
+void AsyncSSD1306::endTransfer() {
+    bool addressing = (_control == CONTROL_COMMAND);
+    for (size_t i = 0; addressing && i < _commandLen; ++i) {
+        addressing = isAddressing(_command[i]);
+    }
+
+    if (_control == CONTROL_COMMAND && addressing) {
+        for (size_t i = 0; i < _commandLen; ++i) {
+            uint8_t cmd = _command[i];
+            if (cmd <= 0x0F) {
+                _column = (_column & 0xF0) | cmd;
+            } else if (cmd <= 0x1F) {
+                _column = ((cmd & 0x07) << 4) | (_column & 0x0F);
+            } else {
+                _page = cmd & 0x07;
+            }
+        }
+    } else if (_control == CONTROL_COMMAND && _pendingLen + _commandLen <= MAX_COMMANDS) {
+        // Power save, contrast, init: sent ahead of the next page data
+        memcpy(_pending + _pendingLen, _command, _commandLen);
+        _pendingLen += _commandLen;
+    }
+    // A frame is complete once the bottom page has been written to its last
+    // column; waking the flush task earlier would send half frames
+    bool frameDone = (_control == CONTROL_DATA && _page == PAGES - 1 && _column == 0);
+    bool commandsPending = (_control == CONTROL_COMMAND && !addressing);
+    xSemaphoreGive(_mutex);
+
+    TaskHandle_t task = _flushTask;
+    if (task != NULL && (frameDone || commandsPending)) xTaskNotifyGive(task);
+}
+
+bool AsyncSSD1306::write(const uint8_t* data, size_t len) {
+    return i2c_master_write_to_device(_port, I2C_ADDRESS, data, len, pdMS_TO_TICKS(50)) == ESP_OK;
+}
+
+void AsyncSSD1306::runFlush() {
+    _flushTask = xTaskGetCurrentTaskHandle();
+    uint8_t from[PAGES];
+    uint8_t to[PAGES];
+
+    // Whatever begin() produced before the task existed goes out first
+    for (;;) {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        size_t commandLen = _pendingLen;
+        memcpy(_txCommands + 1, _pending, commandLen);
+        _pendingLen = 0;
+        bool dirty = false;
+        for (int p = 0; p < PAGES; ++p) {
+            from[p] = _dirtyFrom[p];
+            to[p] = _dirtyTo[p];
+            if (from[p] <= to[p]) {
+                memcpy(&_txFrame[p][from[p] + 1], &_shadow[p][from[p]], to[p] - from[p] + 1);
+                dirty = true;
+            }
+            _dirtyFrom[p] = COLUMNS - 1;
+            _dirtyTo[p] = 0;
+        }
+        xSemaphoreGive(_mutex);
+
+        if (commandLen > 0 || dirty) {
+            int64_t start = esp_timer_get_time();
+            // The commands go first, if they don't make it neither do the pages
+            bool sent = true;
+            if (commandLen > 0) {
+                _txCommands[0] = CONTROL_COMMAND;
+                sent = write(_txCommands, commandLen + 1);
+            }
+            uint8_t failedPages = 0;
+            for (int p = 0; p < PAGES; ++p) {
+                if (from[p] > to[p]) continue;
+                const uint8_t address[] = {CONTROL_COMMAND, (uint8_t)(0x10 | (from[p] >> 4)),
+                                           (uint8_t)(from[p] & 0x0F), (uint8_t)(0xB0 | p)};
+                _txFrame[p][from[p]] = CONTROL_DATA;
+                if (!sent || !write(address, sizeof(address)) ||
+                    !write(&_txFrame[p][from[p]], to[p] - from[p] + 2)) {
+                    failedPages |= 1 << p;
+                }
+            }
+            uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+            _lastFlushUs = elapsed;
+            if (elapsed > _maxFlushUs) _maxFlushUs = elapsed;
+            _flushCount = _flushCount + 1;
+
+            if (!sent || failedPages) {
+                requeue(sent ? 0 : commandLen, from, to, failedPages);
+                _failedFlushes = _failedFlushes + 1;
+                vTaskDelay(pdMS_TO_TICKS(FLUSH_RETRY_MS));
+                continue;
+            }
+        }
+
+        // Partial updates that never reach the bottom page are picked up here
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLUSH_IDLE_MS));
+    }
+}
+
+void AsyncSSD1306::requeue(size_t commandLen, const uint8_t* from, const uint8_t* to, uint8_t pages) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    // The failed commands are older than anything queued since, so they go
+    // back in front; what doesn't fit behind them is dropped as on overflow
+    size_t keep = _pendingLen;
+    if (keep > MAX_COMMANDS - commandLen) keep = MAX_COMMANDS - commandLen;
+    memmove(_pending + commandLen, _pending, keep);
+    memcpy(_pending, _txCommands + 1, commandLen);
+    _pendingLen = commandLen + keep;
+
+    // The shadow still holds the content, so widening the span is enough to
+    // send the failed columns again along with anything drawn since
+    for (int p = 0; p < PAGES; ++p) {
+        if (!(pages & (1 << p))) continue;
+        if (from[p] < _dirtyFrom[p]) _dirtyFrom[p] = from[p];
+        if (to[p] > _dirtyTo[p]) _dirtyTo[p] = to[p];
+    }
+    xSemaphoreGive(_mutex);
+}
+
+uint32_t AsyncSSD1306::lastFlushUs() const {
+    return _lastFlushUs;
+}
+
+uint32_t AsyncSSD1306::maxFlushUs() const {
+    return _maxFlushUs;
+}
+
+uint32_t AsyncSSD1306::flushCount() const {
+    return _flushCount;
+}
+
+uint32_t AsyncSSD1306::failedFlushes() const {
+    return _failedFlushes;
+}
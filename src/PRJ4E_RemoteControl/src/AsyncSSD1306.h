@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+#include <U8g2lib.h>
+#include <driver/i2c.h>
+
+// SSD1306 128x64 on the ESP-IDF I2C driver with the bus moved off the
+// drawing tasks. sendBuffer() runs U8g2's normal tile output into a byte
+// callback that only updates a shadow of the panel RAM and marks the changed
+// column span of each page. The flush task copies the dirty spans into a
+// second buffer and writes them out at fast-mode clock while the next frame
+// is drawn. Frames drawn faster than the bus drains them are merged, so the
+// panel always ends up on the latest frame and nothing queues up.
+//
+// The ESP32 I2C controller has no DMA, it is fed from a 32-byte FIFO by the
+// driver's interrupt handler; only the flush task waits on it.
+class AsyncSSD1306 : public U8G2 {
+public:
+    explicit AsyncSSD1306(const u8g2_cb_t* rotation);
+
+    // Call before begin(). Installs the I2C master driver on I2C_NUM_0.
+    bool beginBus(int sda, int scl, uint32_t clockHz);
+
+    // Body of the flush task, never returns
+    void runFlush();
+
+    // Bus time of the last and slowest flush, for the "DISPLAY" command
+    uint32_t lastFlushUs() const;
+    uint32_t maxFlushUs() const;
+    uint32_t flushCount() const;
+    uint32_t failedFlushes() const;  // Flushes with an I2C error, retried
+
+    static constexpr uint8_t I2C_ADDRESS = 0x3C;
+    static constexpr int PAGES = 8;
+    static constexpr int COLUMNS = 128;
+
+private:
+    static constexpr size_t MAX_COMMANDS = 64;  // Init sequence is about 30 bytes
+    static constexpr uint32_t FLUSH_IDLE_MS = 100;
+    static constexpr uint32_t FLUSH_RETRY_MS = 20;  // After a write failed
+
+    static uint8_t byteCallback(u8x8_t* u8x8, uint8_t msg, uint8_t argInt, void* argPtr);
+    void startTransfer();
+    void sendBytes(const uint8_t* data, size_t len);
+    void endTransfer();
+    bool write(const uint8_t* data, size_t len);
+    void requeue(size_t commandLen, const uint8_t* from, const uint8_t* to, uint8_t pages);
+
+    i2c_port_t _port;
+    volatile TaskHandle_t _flushTask;
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+
+    // Current transfer, only touched by the drawing task holding _mutex
+    uint8_t _control;  // 0x00 command stream, 0x40 data stream
+    bool _controlSeen;
+    uint8_t _command[MAX_COMMANDS];
+    size_t _commandLen;
+    int _page;
+    int _column;
+
+    // Shared with the flush task, guarded by _mutex
+    uint8_t _shadow[PAGES][COLUMNS];  // What the panel should show
+    uint8_t _dirtyFrom[PAGES];        // Column span per page, From > To when clean
+    uint8_t _dirtyTo[PAGES];
+    uint8_t _pending[MAX_COMMANDS];   // Non-addressing commands, sent before the pages
+    size_t _pendingLen;
+
+    // Flush task only. Column c sits at index c + 1 so the 0x40 control byte
+    // fits in front of any span without copying.
+    uint8_t _txFrame[PAGES][COLUMNS + 1];
+    uint8_t _txCommands[MAX_COMMANDS + 1];
+
+    volatile uint32_t _lastFlushUs;
+    volatile uint32_t _maxFlushUs;
+    volatile uint32_t _flushCount;
+    volatile uint32_t _failedFlushes;
+};
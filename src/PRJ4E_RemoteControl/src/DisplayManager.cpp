@@ -2,7 +2,7 @@
 #include <DallasTemperature.h>
 
 
-DisplayManager::DisplayManager(U8G2_SSD1306_128X64_NONAME_F_HW_I2C& display)
+DisplayManager::DisplayManager(U8G2& display)
     : _display(display) {}
 
 void DisplayManager::init() {
@@ -30,6 +30,47 @@ void DisplayManager::goToSetTempScreen() {
     updateSetTempScreen(0);  // force initial draw
 }
 
+void DisplayManager::goToModeScreen(const char* const* modeNames, int modeCount, int activeMode) {
+    _currentScreen = MODE_SCREEN;
+    _modeNames = modeNames;
+    _modeCount = modeCount;
+    _activeMode = activeMode;
+    _selectedMode = activeMode;
+    _blinkVisible = true;
+    _lastBlinkToggle = millis();
+    drawModeScreen();
+}
+
+void DisplayManager::goToGraphScreen(const HistoryFormat::Sample* samples, size_t count, const char* title) {
+    _currentScreen = GRAPH_SCREEN;
+    _graphSamples = samples;
+    _graphCount = count > (size_t)GRAPH_POINTS ? GRAPH_POINTS : count;
+    _graphTitle = title;
+    drawGraph();
+}
+
+void DisplayManager::sleep() {
+    _asleep = true;
+    _display.setPowerSave(1);
+}
+
+// Redraws the current screen, nothing was drawn while the panel was off
+void DisplayManager::wake() {
+    _asleep = false;
+    _display.setPowerSave(0);
+    switch (_currentScreen) {
+        case MENU_SCREEN: drawMenu(); break;
+        case MODE_SCREEN: drawModeScreen(); break;
+        case GRAPH_SCREEN: drawGraph(); break;
+        case SET_TEMP_SCREEN: updateSetTempScreen(0); break;
+        default: goToTempScreen(); break;
+    }
+}
+
+bool DisplayManager::isAsleep() const {
+    return _asleep;
+}
+
 bool DisplayManager::isMenuScreen() const {
     return _currentScreen == MENU_SCREEN;
 }
@@ -38,11 +79,31 @@ bool DisplayManager::isSetTempScreen() const {
     return _currentScreen == SET_TEMP_SCREEN;
 }
 
+bool DisplayManager::isModeScreen() const {
+    return _currentScreen == MODE_SCREEN;
+}
+
+bool DisplayManager::isGraphScreen() const {
+    return _currentScreen == GRAPH_SCREEN;
+}
+
 int DisplayManager::getSelectedIndex() const {
     return _selectedIndex;
 }
 
+int DisplayManager::getSelectedMode() const {
+    return _selectedMode;
+}
+
 void DisplayManager::moveSelection(int direction) {
+    if (_currentScreen == MODE_SCREEN) {
+        _selectedMode += direction;
+        if (_selectedMode < 0) _selectedMode = _modeCount - 1;
+        if (_selectedMode >= _modeCount) _selectedMode = 0;
+        drawModeScreen();
+        return;
+    }
+
     _selectedIndex += direction;
     if (_selectedIndex < 0) _selectedIndex = _menuItemCount - 1;
     if (_selectedIndex >= _menuItemCount) _selectedIndex = 0;
@@ -50,7 +111,7 @@ void DisplayManager::moveSelection(int direction) {
 }
 
 void DisplayManager::updateTemperature(float tempC) {
-    if (_currentScreen != TEMP_SCREEN) return;
+    if (_currentScreen != TEMP_SCREEN || _asleep) return;
 
     // Static variables to keep state between calls
     static float lastValidTemp = DEVICE_DISCONNECTED_C;
@@ -93,17 +154,47 @@ void DisplayManager::drawStaticUI() {
     _display.drawFrame(0, 0, 128, 64);
     _display.setFont(u8g2_font_6x12_tr);
     _display.drawStr((128 - _display.getStrWidth("Temp")) / 2, 12, "Temp");
+    drawLinkStatus();
+}
+
+void DisplayManager::updateLinkStatus(int rssi, bool actuatorStalled) {
+    _linkRssi = rssi;
+    _actuatorStalled = actuatorStalled;
+}
+
+// Signal bars in the top right corner, "!" when the valve is stuck
+void DisplayManager::drawLinkStatus() {
+    if (_linkRssi == 0) return;
+
+    int bars = 0;
+    if (_linkRssi > -120) bars = 1;
+    if (_linkRssi > -110) bars = 2;
+    if (_linkRssi > -95) bars = 3;
+    if (_linkRssi > -80) bars = 4;
+
+    int x = 104, baseY = 11;
+    for (int i = 0; i < 4; ++i) {
+        int h = 2 + i * 2;
+        if (i < bars) _display.drawBox(x + i * 4, baseY - h, 3, h);
+        else _display.drawFrame(x + i * 4, baseY - h, 3, h);
+    }
+
+    if (_actuatorStalled) {
+        _display.setFont(u8g2_font_6x12_tr);
+        _display.drawStr(96, 11, "!");
+    }
 }
 
 void DisplayManager::drawMenu() {
+    if (_asleep) return;
     _display.clearBuffer();
     _display.drawFrame(0, 0, 128, 64);
     _display.setFont(u8g2_font_6x12_tr);
     _display.drawStr((128 - _display.getStrWidth("Menu")) / 2, 12, "Menu");
 
-    const char* items[_menuItemCount] = {"Temp Monitor", "Set Temp", "Mode"};
-    int baseY = 28;
-    int spacing = 16;
+    const char* items[_menuItemCount] = {"Temp Monitor", "Set Temp", "Mode", "History"};
+    int baseY = 25;
+    int spacing = 12;
 
     for (int i = 0; i < _menuItemCount; ++i) {
         if (i != _selectedIndex || _blinkVisible) {
@@ -115,6 +206,83 @@ void DisplayManager::drawMenu() {
     _display.sendBuffer();
 }
 
+// Same layout as the menu, "*" marks the mode that is currently active
+void DisplayManager::drawModeScreen() {
+    if (_asleep) return;
+    _display.clearBuffer();
+    _display.drawFrame(0, 0, 128, 64);
+    _display.setFont(u8g2_font_6x12_tr);
+    _display.drawStr((128 - _display.getStrWidth("Mode")) / 2, 12, "Mode");
+
+    int baseY = 25;
+    int spacing = 12;
+
+    for (int i = 0; i < _modeCount; ++i) {
+        if (i != _selectedMode || _blinkVisible) {
+            if (i == _selectedMode) _display.drawStr(10, baseY + i * spacing, ">");
+            _display.drawStr(20, baseY + i * spacing, _modeNames[i]);
+        }
+        if (i == _activeMode) _display.drawStr(110, baseY + i * spacing, "*");
+    }
+
+    _display.sendBuffer();
+}
+
+// Newest sample at the right edge. The scale covers temperature and target
+// with at least 2 C; the line breaks where the history has a reboot gap.
+void DisplayManager::drawGraph() {
+    if (_asleep) return;
+    _display.clearBuffer();
+    _display.drawFrame(0, 0, 128, 64);
+    _display.setFont(u8g2_font_6x12_tr);
+    _display.drawStr((128 - _display.getStrWidth(_graphTitle)) / 2, 12, _graphTitle);
+
+    if (_graphCount < 2) {
+        _display.drawStr((128 - _display.getStrWidth("No data yet")) / 2, 38, "No data yet");
+        _display.sendBuffer();
+        return;
+    }
+
+    int lo = _graphSamples[0].temp, hi = lo;
+    for (size_t i = 0; i < _graphCount; ++i) {
+        const HistoryFormat::Sample& s = _graphSamples[i];
+        lo = min(lo, (int)min(s.temp, s.target));
+        hi = max(hi, (int)max(s.temp, s.target));
+    }
+    if (hi - lo < 20) {
+        int mid = (hi + lo) / 2;
+        lo = mid - 10;
+        hi = mid + 10;
+    }
+
+    const int plotLeft = 127 - GRAPH_POINTS - 4, plotTop = 16, plotBottom = 53;
+    const int valveBottom = 61, valveHeight = 6;
+    int x = plotLeft + (GRAPH_POINTS - (int)_graphCount);
+    int lastY = 0;
+    for (size_t i = 0; i < _graphCount; ++i, ++x) {
+        const HistoryFormat::Sample& s = _graphSamples[i];
+        int y = plotBottom - (s.temp - lo) * (plotBottom - plotTop) / (hi - lo);
+        if (i > 0 && !s.gap) _display.drawLine(x - 1, lastY, x, y);
+        else _display.drawPixel(x, y);
+        lastY = y;
+
+        if (x % 2 == 0) _display.drawPixel(x, plotBottom - (s.target - lo) * (plotBottom - plotTop) / (hi - lo));
+
+        int valvePx = (s.valve * valveHeight + 50) / 100;
+        if (valvePx > 0) _display.drawVLine(x, valveBottom - valvePx + 1, valvePx);
+    }
+
+    char label[8];
+    _display.setFont(u8g2_font_4x6_tr);
+    snprintf(label, sizeof(label), "%.1f", hi / 10.0f);
+    _display.drawStr(3, plotTop + 5, label);
+    snprintf(label, sizeof(label), "%.1f", lo / 10.0f);
+    _display.drawStr(3, plotBottom, label);
+    _display.drawStr(3, valveBottom, "vlv");
+
+    _display.sendBuffer();
+}
+
 void DisplayManager::drawThermometer(float tempC) {
     if (tempC == DEVICE_DISCONNECTED_C) return;
 
@@ -148,11 +316,12 @@ void DisplayManager::tickBlink() {
         _blinkVisible = !_blinkVisible;
         _lastBlinkToggle = millis();
         if (_currentScreen == MENU_SCREEN) drawMenu();
+        else if (_currentScreen == MODE_SCREEN) drawModeScreen();
     }
 }
 
 void DisplayManager::updateSetTempScreen(float currentTemp) {
-    if (_currentScreen != SET_TEMP_SCREEN) return;
+    if (_currentScreen != SET_TEMP_SCREEN || _asleep) return;
 
     // --- Static buffer to avoid displaying "Err" too quickly
     static float lastValidTemp = DEVICE_DISCONNECTED_C;
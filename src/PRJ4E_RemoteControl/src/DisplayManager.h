@@ -2,18 +2,22 @@
 
 #include <U8g2lib.h>
 #include <Arduino.h>
+#include "HistoryFormat.h"
 
 class DisplayManager {
 public:
-    enum Screen { TEMP_SCREEN, MENU_SCREEN, SET_TEMP_SCREEN };
+    enum Screen { TEMP_SCREEN, MENU_SCREEN, SET_TEMP_SCREEN, MODE_SCREEN, GRAPH_SCREEN };
 
-    DisplayManager(U8G2_SSD1306_128X64_NONAME_F_HW_I2C& display);
+    static const int GRAPH_POINTS = 96;  // One pixel column per sample
+
+    DisplayManager(U8G2& display);
     void init();
 
     void updateTemperature(float tempC);
     void moveSelection(int direction);
     void tickBlink();
     void updateSetTempScreen(float currentTemp);
+    void updateLinkStatus(int rssi, bool actuatorStalled);
 
     void setTargetTemp(float temp);
     void increaseTargetTemp();
@@ -24,16 +28,29 @@ public:
     void goToMenuScreen();
     void goToTempScreen();
     void goToSetTempScreen();
+    // Lists the modes with the active one marked; names must stay valid
+    void goToModeScreen(const char* const* modeNames, int modeCount, int activeMode);
+    // Room temperature line, dotted target and valve bars, oldest sample
+    // first; samples must stay valid while the screen is shown
+    void goToGraphScreen(const HistoryFormat::Sample* samples, size_t count, const char* title);
+
+    // Display timeout: drawing is skipped while the panel is off
+    void sleep();
+    void wake();
+    bool isAsleep() const;
 
     // State helpers
     bool isMenuScreen() const;
     bool isSetTempScreen() const;
+    bool isModeScreen() const;
+    bool isGraphScreen() const;
     int getSelectedIndex() const;
+    int getSelectedMode() const;
 
     float getTargetTemp();
 
 private:
-    U8G2_SSD1306_128X64_NONAME_F_HW_I2C& _display;
+    U8G2& _display;
 
     Screen _currentScreen = TEMP_SCREEN;
 
@@ -43,13 +60,30 @@ private:
     bool _blinkOn = true;
 
     int _selectedIndex = 0;
-    const int _menuItemCount = 3;
+    const int _menuItemCount = 4;
 
     bool _blinkVisible = true;
     unsigned long _lastBlinkToggle = 0;
 
+    const char* const* _modeNames = nullptr;
+    int _modeCount = 0;
+    int _activeMode = 0;
+    int _selectedMode = 0;
+
+    const HistoryFormat::Sample* _graphSamples = nullptr;
+    size_t _graphCount = 0;
+    const char* _graphTitle = "";
+
+    bool _asleep = false;
+
+    int _linkRssi = 0;          // 0 = no status received yet
+    bool _actuatorStalled = false;
+
     void drawStaticUI();
+    void drawLinkStatus();
     void drawMenu();
+    void drawModeScreen();
+    void drawGraph();
     void drawThermometer(float tempC);
     void drawSetTempUI(float currentTemp);
     
@@ -0,0 +1,182 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact temperature history, shared by HistoryStore, DisplayManager and
+// the host bench. Every tier stores one sample per fixed interval, so no
+// timestamps are kept. A record starts with a header byte:
+//   bits 7..5  room temperature delta + 3 [0.1 C], 7 = zigzag varint delta follows
+//   bit 4      target changed, zigzag varint delta follows [0.1 C]
+//   bit 3      valve changed, zigzag varint delta follows [%]
+//   bits 2..0  number of identical samples that follow (0..6), 7 = keyframe
+// Headers KEYFRAME and KEYFRAME_GAP start a chain with absolute values
+// (zigzag varint room temperature, zigzag varint target, varint valve).
+// Every file opens with a keyframe; KEYFRAME_GAP follows a reboot, so the
+// time since the previous sample is unknown and the graph breaks there.
+// A settled room takes 1 byte per 7 samples, a drifting one 1 byte each.
+namespace HistoryFormat {
+
+const uint8_t KEYFRAME = 0x0F;
+const uint8_t KEYFRAME_GAP = 0x07;
+const int MAX_RUN = 6;
+const size_t MAX_RECORD = 1 + 3 * 3;  // Header and three 3-byte varints
+
+struct Sample {
+    int16_t temp;    // [0.1 C]
+    int16_t target;  // [0.1 C]
+    uint8_t valve;   // [%]
+    bool gap;        // First sample after a reboot
+};
+
+inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+inline size_t putVarint(uint8_t* p, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns the bytes used, 0 if the varint runs past end
+inline size_t getVarint(const uint8_t* p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (size_t n = 0; n < 5 && p + n < end; ++n) {
+        v |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80)) return n + 1;
+    }
+    return 0;
+}
+
+inline bool sameValues(const Sample& a, const Sample& b) {
+    return a.temp == b.temp && a.target == b.target && a.valve == b.valve;
+}
+
+// Holds back the newest record so identical samples can still be folded
+// into its run count. add() returns the bytes of the record it completed.
+class Encoder {
+public:
+    Encoder() { reset(true); }
+
+    // The next sample starts a new chain with a keyframe. Call flush()
+    // first, the held-back record is dropped.
+    void reset(bool gap) {
+        _started = false;
+        _gap = gap;
+        _pendingLen = 0;
+    }
+
+    size_t add(const Sample& s, uint8_t* out) {
+        if (_started && _pendingLen > 0 && sameValues(s, _last) && (_pending[0] & 0x07) < MAX_RUN) {
+            _pending[0]++;
+            return 0;
+        }
+
+        size_t done = flush(out);
+        if (!_started) {
+            _pending[0] = _gap ? KEYFRAME_GAP : KEYFRAME;
+            _pendingLen = 1;
+            _pendingLen += putVarint(_pending + _pendingLen, zigzag(s.temp));
+            _pendingLen += putVarint(_pending + _pendingLen, zigzag(s.target));
+            _pendingLen += putVarint(_pending + _pendingLen, s.valve);
+            _started = true;
+        } else {
+            int32_t dTemp = s.temp - _last.temp;
+            uint8_t header = (dTemp >= -3 && dTemp <= 3) ? (uint8_t)((dTemp + 3) << 5) : 0xE0;
+            _pendingLen = 1;
+            if (header == 0xE0) _pendingLen += putVarint(_pending + _pendingLen, zigzag(dTemp));
+            if (s.target != _last.target) {
+                header |= 0x10;
+                _pendingLen += putVarint(_pending + _pendingLen, zigzag(s.target - _last.target));
+            }
+            if (s.valve != _last.valve) {
+                header |= 0x08;
+                _pendingLen += putVarint(_pending + _pendingLen, zigzag(s.valve - _last.valve));
+            }
+            _pending[0] = header;
+        }
+        _last = s;
+        return done;
+    }
+
+    // Hands over the held-back record, e.g. before a file is rotated
+    size_t flush(uint8_t* out) {
+        for (size_t i = 0; i < _pendingLen; ++i) out[i] = _pending[i];
+        size_t n = _pendingLen;
+        _pendingLen = 0;
+        return n;
+    }
+
+    // The held-back record without giving it up, for queries
+    const uint8_t* pending(size_t& len) const {
+        len = _pendingLen;
+        return _pending;
+    }
+
+private:
+    uint8_t _pending[MAX_RECORD];
+    size_t _pendingLen;
+    Sample _last;
+    bool _started;
+    bool _gap;
+};
+
+// Decodes one record at p. Returns the bytes consumed, 0 if the record is
+// incomplete (read more) or invalid. repeat is the number of copies of s
+// that follow.
+inline size_t decodeRecord(const uint8_t* p, const uint8_t* end, Sample& s, int& repeat) {
+    if (p >= end) return 0;
+    const uint8_t* q = p + 1;
+    uint8_t header = *p;
+    bool keyframe = (header == KEYFRAME || header == KEYFRAME_GAP);
+    Sample t = s;  // s stays untouched if the record is incomplete
+    uint32_t v;
+    size_t n;
+
+    if (keyframe) {
+        if (!(n = getVarint(q, end, v))) return 0;
+        t.temp = (int16_t)unzigzag(v);
+        q += n;
+        if (!(n = getVarint(q, end, v))) return 0;
+        t.target = (int16_t)unzigzag(v);
+        q += n;
+        if (!(n = getVarint(q, end, v)) || v > 100) return 0;
+        t.valve = (uint8_t)v;
+        q += n;
+        t.gap = (header == KEYFRAME_GAP);
+    } else {
+        if ((header & 0x07) > MAX_RUN) return 0;
+        int code = header >> 5;
+        if (code == 7) {
+            if (!(n = getVarint(q, end, v))) return 0;
+            t.temp += (int16_t)unzigzag(v);
+            q += n;
+        } else {
+            t.temp += code - 3;
+        }
+        if (header & 0x10) {
+            if (!(n = getVarint(q, end, v))) return 0;
+            t.target += (int16_t)unzigzag(v);
+            q += n;
+        }
+        if (header & 0x08) {
+            if (!(n = getVarint(q, end, v))) return 0;
+            t.valve = (uint8_t)(t.valve + unzigzag(v));
+            q += n;
+        }
+        t.gap = false;
+    }
+    s = t;
+    repeat = keyframe ? 0 : (header & 0x07);
+    return q - p;
+}
+
+}  // namespace HistoryFormat
@@ -0,0 +1,219 @@
+#include "HistoryStore.h"
+#include <LittleFS.h>
+#include <algorithm>
+
+using HistoryFormat::Sample;
+
+static const char* FILE_READ_APPEND = "a+";  // Writes always go to the end
+
+HistoryStore::HistoryStore()
+    : _tiers{{"/hist_m.bin", "/hist_m.old", 8192, 60},
+             {"/hist_h.bin", "/hist_h.old", 4096, 24},
+             {"/hist_d.bin", "/hist_d.old", 2048, 0}},
+      _hasLastMinute(false), _minuteStartMs(0), _mutex(NULL), _ready(false) {}
+
+uint32_t HistoryStore::intervalMinutes(Tier tier) {
+    switch (tier) {
+        case HOUR: return 60;
+        case DAY: return 24 * 60;
+        default: return 1;
+    }
+}
+
+bool HistoryStore::begin() {
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    if (!LittleFS.begin(true)) {
+        Serial.println("LittleFS mount failed, history disabled.");
+        return false;
+    }
+
+    for (int i = 0; i < TIER_COUNT; ++i) {
+        TierState& t = _tiers[i];
+        t.file = LittleFS.open(t.path, FILE_READ_APPEND);
+        if (!t.file) return false;
+        t.oldFile = LittleFS.open(t.oldPath, FILE_READ);
+        t.tempSum = t.targetSum = t.valveSum = 0;
+        t.count = 0;
+        t.gapNext = true;  // A fresh encoder, see HistoryFormat::Encoder
+
+        // Decoded once for the tail, and counted so queries know whether
+        // the old segment is needed
+        Sample state = {};
+        size_t oldSamples = 0;
+        if (t.oldFile) decodeFile(t.oldFile, state, t.tail, TAIL_SAMPLES, oldSamples);
+        t.tailTotal = oldSamples;
+        decodeFile(t.file, state, t.tail, TAIL_SAMPLES, t.tailTotal);
+        t.samples = t.tailTotal - oldSamples;
+    }
+    _minuteStartMs = millis();
+    _ready = true;
+    return true;
+}
+
+void HistoryStore::add(uint32_t nowMs, float temp, float target, int valve) {
+    if (!_ready) return;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    // Close the minutes that ended before this cycle, repeating the last
+    // sample for minutes without one
+    uint32_t elapsed = (nowMs - _minuteStartMs) / MINUTE_MS;
+    if (elapsed > MAX_CATCH_UP) {
+        breakChains();
+        _tiers[MINUTE].count = 0;
+        _minuteStartMs = nowMs;
+        elapsed = 0;
+    }
+    for (uint32_t i = 0; i < elapsed; ++i) {
+        TierState& m = _tiers[MINUTE];
+        if (m.count > 0) {
+            _lastMinute.temp = (int16_t)lroundf((float)m.tempSum / m.count);
+            _lastMinute.target = (int16_t)lroundf((float)m.targetSum / m.count);
+            _lastMinute.valve = (uint8_t)lroundf((float)m.valveSum / m.count);
+            _hasLastMinute = true;
+        }
+        if (_hasLastMinute) emit(MINUTE, _lastMinute);
+        m.tempSum = m.targetSum = m.valveSum = 0;
+        m.count = 0;
+        _minuteStartMs += MINUTE_MS;
+    }
+
+    TierState& m = _tiers[MINUTE];
+    m.tempSum += lroundf(temp * 10.0f);
+    m.targetSum += lroundf(target * 10.0f);
+    m.valveSum += constrain(valve, 0, 100);
+    m.count++;
+
+    xSemaphoreGive(_mutex);
+}
+
+void HistoryStore::emit(int tier, const Sample& sample) {
+    TierState& t = _tiers[tier];
+    uint8_t record[HistoryFormat::MAX_RECORD];
+    size_t n = t.encoder.add(sample, record);
+    t.samples++;
+
+    // As a query of the file would decode it
+    Sample& cached = t.tail[t.tailTotal++ % TAIL_SAMPLES];
+    cached = sample;
+    cached.gap = t.gapNext;
+    t.gapNext = false;
+
+    append(t, record, n);
+    if (tier + 1 < TIER_COUNT) accumulate(tier + 1, sample);
+}
+
+// Every record goes through here, so the segment size is checked after each
+void HistoryStore::append(TierState& t, const uint8_t* record, size_t len) {
+    if (len == 0) return;
+    t.file.write(record, len);
+    t.file.flush();
+    if (t.file.size() >= t.segmentBytes) rotate(t);
+}
+
+// After a stall too long to fill in, every tier writes out what it holds
+// and continues with KEYFRAME_GAP, so the graph breaks there
+void HistoryStore::breakChains() {
+    for (int i = 0; i < TIER_COUNT; ++i) {
+        TierState& t = _tiers[i];
+        uint8_t record[HistoryFormat::MAX_RECORD];
+        size_t n = t.encoder.flush(record);
+        append(t, record, n);
+        t.encoder.reset(true);
+        t.gapNext = true;
+    }
+}
+
+// Averages samples of the tier below and emits one per samplesPerParent
+void HistoryStore::accumulate(int tier, const Sample& sample) {
+    TierState& t = _tiers[tier];
+    t.tempSum += sample.temp;
+    t.targetSum += sample.target;
+    t.valveSum += sample.valve;
+    if (++t.count < _tiers[tier - 1].samplesPerParent) return;
+
+    Sample mean = {};
+    mean.temp = (int16_t)lroundf((float)t.tempSum / t.count);
+    mean.target = (int16_t)lroundf((float)t.targetSum / t.count);
+    mean.valve = (uint8_t)lroundf((float)t.valveSum / t.count);
+    t.tempSum = t.targetSum = t.valveSum = 0;
+    t.count = 0;
+    emit(tier, mean);
+}
+
+// The new file starts with a plain keyframe, the chain itself goes on
+void HistoryStore::rotate(TierState& t) {
+    uint8_t record[HistoryFormat::MAX_RECORD];
+    size_t n = t.encoder.flush(record);
+    t.file.write(record, n);
+    t.file.close();
+    t.oldFile.close();
+    LittleFS.remove(t.oldPath);
+    LittleFS.rename(t.path, t.oldPath);
+    t.file = LittleFS.open(t.path, FILE_READ_APPEND);
+    t.oldFile = LittleFS.open(t.oldPath, FILE_READ);
+    t.encoder.reset(false);
+    t.samples = 0;
+}
+
+size_t HistoryStore::query(Tier tier, Sample* out, size_t maxSamples) {
+    if (!_ready || maxSamples == 0) return 0;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    TierState& t = _tiers[tier];
+    if (maxSamples <= TAIL_SAMPLES || t.tailTotal <= TAIL_SAMPLES) {
+        size_t count = t.tailTotal < TAIL_SAMPLES ? t.tailTotal : TAIL_SAMPLES;
+        if (count > maxSamples) count = maxSamples;
+        for (size_t i = 0; i < count; ++i) out[i] = t.tail[(t.tailTotal - count + i) % TAIL_SAMPLES];
+        xSemaphoreGive(_mutex);
+        return count;
+    }
+
+    // out is filled as a ring and put in order at the end
+    Sample state = {};
+    size_t total = 0;
+    if (t.samples < maxSamples && t.oldFile) decodeFile(t.oldFile, state, out, maxSamples, total);
+    decodeFile(t.file, state, out, maxSamples, total);
+
+    size_t pendingLen;
+    const uint8_t* pending = t.encoder.pending(pendingLen);
+    int repeat;
+    if (HistoryFormat::decodeRecord(pending, pending + pendingLen, state, repeat) > 0) {
+        for (int i = 0; i <= repeat; ++i) {
+            out[total++ % maxSamples] = state;
+            state.gap = false;
+        }
+    }
+    xSemaphoreGive(_mutex);
+
+    if (total <= maxSamples) return total;
+    std::rotate(out, out + total % maxSamples, out + maxSamples);
+    return maxSamples;
+}
+
+// Decodes a whole file into the ring (or only counts samples if out is
+// NULL). LittleFS commits a write whole on flush, so a power cut never
+// leaves half a record behind.
+void HistoryStore::decodeFile(File& file, Sample& state, Sample* out, size_t maxSamples, size_t& total) {
+    uint8_t buf[128];
+    size_t have = 0;
+    file.seek(0);
+    for (;;) {
+        size_t n = file.read(buf + have, sizeof(buf) - have);
+        have += n;
+
+        size_t pos = 0, used;
+        int repeat;
+        while ((used = HistoryFormat::decodeRecord(buf + pos, buf + have, state, repeat)) > 0) {
+            pos += used;
+            for (int i = 0; i <= repeat; ++i) {
+                if (out) out[total % maxSamples] = state;
+                total++;
+                state.gap = false;
+            }
+        }
+        // Stops at the end of the file and on a damaged record
+        if (n == 0) break;
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "HistoryFormat.h"
+
+// Room temperature, target and valve position at minute, hour and day
+// resolution on LittleFS, for the graph screen. Control cycles are averaged
+// into one minute sample, 60 of those into an hour and 24 hours into a day.
+// Each finished sample costs one HistoryFormat record appended to its tier
+// file, with no scan or rewrite. A tier file is rotated to .old once it
+// reaches its segment size, so each tier keeps one to two segments. A
+// simulated month with sensor noise averaged about 4 bits per sample:
+//   minute  8 KB   about 10 days per segment
+//   hour    4 KB   over half a year
+//   day     2 KB   several years
+// The newest TAIL_SAMPLES of each tier are also kept decoded in RAM, filled
+// once in begin() and then on every sample, so a graph view copies them
+// instead of decoding the files.
+class HistoryStore {
+public:
+    enum Tier { MINUTE, HOUR, DAY, TIER_COUNT };
+    static constexpr size_t TAIL_SAMPLES = 96;  // One graph, DisplayManager::GRAPH_POINTS
+
+    HistoryStore();
+    bool begin();  // Mounts LittleFS if needed; the first sample marks a gap
+
+    // Once per control cycle. Minutes without a call repeat the last sample.
+    void add(uint32_t nowMs, float temp, float target, int valve);
+
+    // The latest samples of a tier, oldest first. Returns the count written.
+    // Up to TAIL_SAMPLES come from RAM, more are decoded from the files.
+    size_t query(Tier tier, HistoryFormat::Sample* out, size_t maxSamples);
+
+    // Sample interval of a tier, for axis labels
+    static uint32_t intervalMinutes(Tier tier);
+
+private:
+    static constexpr uint32_t MINUTE_MS = 60000;
+    static constexpr uint32_t MAX_CATCH_UP = 60;  // Longer stalls start a new chain
+
+    struct TierState {
+        const char* path;
+        const char* oldPath;
+        size_t segmentBytes;
+        int samplesPerParent;  // Samples averaged into one of the next tier
+        File file;             // Kept open for append and read, opening allocates
+        File oldFile;
+        HistoryFormat::Encoder encoder;
+        size_t samples;        // In file, including the held-back record
+        int32_t tempSum;
+        int32_t targetSum;
+        int32_t valveSum;
+        int count;
+        HistoryFormat::Sample tail[TAIL_SAMPLES];  // Ring, the newest at tailTotal - 1
+        size_t tailTotal;      // Samples ever put in the ring
+        bool gapNext;          // The encoder starts a chain with KEYFRAME_GAP
+    };
+
+    void emit(int tier, const HistoryFormat::Sample& sample);
+    void append(TierState& t, const uint8_t* record, size_t len);
+    void breakChains();
+    void accumulate(int tier, const HistoryFormat::Sample& sample);
+    void rotate(TierState& t);
+    void decodeFile(File& file, HistoryFormat::Sample& state, HistoryFormat::Sample* out, size_t maxSamples,
+                    size_t& total);
+
+    TierState _tiers[TIER_COUNT];
+    HistoryFormat::Sample _lastMinute;
+    bool _hasLastMinute;
+    uint32_t _minuteStartMs;
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+    bool _ready;
+};
@@ -7,11 +7,79 @@
 #define LORA_RST 14
 #define LORA_DI0 26
 
-LoRaDevice::LoRaDevice() {}
+#define MAX_FRAME_SIZE 96
+
+LoRaDevice::LoRaDevice() : mutex(NULL), auth('R', 'M'), listening(false), rssi(0), snr(0.0f) {}
 
 bool LoRaDevice::begin(long frequency) {
+  mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+  auth.begin();
   SPI.begin(LORA_SCK, LORA_MISO, LORA_MOSI, LORA_SS);
   LoRa.setPins(LORA_SS, LORA_RST, LORA_DI0);
   return LoRa.begin(frequency);
 }
 
+bool LoRaDevice::send(const char* payload) {
+  char frame[MAX_FRAME_SIZE];
+  strlcpy(frame, payload, sizeof(frame));
+  if (!auth.seal(frame, sizeof(frame))) return false;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  LoRa.beginPacket();
+  LoRa.print(frame);
+  bool ok = LoRa.endPacket();
+  if (listening) LoRa.receive();
+  xSemaphoreGive(mutex);
+  return ok;
+}
+
+// Returns the payload length (0 when nothing valid arrived), always null
+// terminated. The buffer must also fit FrameAuth::OVERHEAD.
+int LoRaDevice::receive(char* buffer, size_t size) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  int len = 0;
+  if (LoRa.parsePacket()) {
+    while (LoRa.available()) {
+      char c = (char)LoRa.read();
+      if (len < (int)size - 1) buffer[len++] = c;
+    }
+    rssi = LoRa.packetRssi();
+    snr = LoRa.packetSnr();
+  }
+  // parsePacket() leaves the radio idle or in single receive
+  if (listening) LoRa.receive();
+  buffer[len] = '\0';
+  xSemaphoreGive(mutex);
+
+  if (len > 0 && !auth.open(buffer)) {
+    Serial.printf("Dropped unauthenticated frame (%u so far)\n", (unsigned)auth.rejectedFrames());
+    buffer[0] = '\0';
+    return 0;
+  }
+  return strlen(buffer);
+}
+
+// DIO0 is mapped to RxDone in receive mode
+void LoRaDevice::listen(void (*onPacket)()) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  listening = true;
+  LoRa.receive();
+  xSemaphoreGive(mutex);
+  attachInterrupt(digitalPinToInterrupt(LORA_DI0), onPacket, RISING);
+}
+
+bool LoRaDevice::provisionKey(const char* hex) {
+  return auth.provisionKey(hex);
+}
+
+uint32_t LoRaDevice::rejectedFrames() {
+  return auth.rejectedFrames();
+}
+
+int LoRaDevice::lastRssi() {
+  return rssi;
+}
+
+float LoRaDevice::lastSnr() {
+  return snr;
+}
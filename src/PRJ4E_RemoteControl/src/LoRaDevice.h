@@ -3,11 +3,36 @@
 
 #include <Arduino.h>
 #include <LoRa.h>
+#include "FrameAuth.h"
 
 class LoRaDevice {
   public:
     LoRaDevice();
     bool begin(long frequency);
+
+    // Radio access is guarded by a mutex for callers on any task. Frames are
+    // sealed and checked with FrameAuth; unauthenticated frames are dropped.
+    bool send(const char* payload);
+    int receive(char* buffer, size_t size);
+
+    // Keeps the radio in continuous receive, also after each send and
+    // receive, and calls onPacket from the DIO0 interrupt when a frame is in.
+    // Call from setup(), attaching the interrupt allocates.
+    void listen(void (*onPacket)());
+
+    bool provisionKey(const char* hex);
+    uint32_t rejectedFrames();
+
+    int lastRssi();
+    float lastSnr();
+
+  private:
+    SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutexBuffer;
+    FrameAuth auth;
+    bool listening;
+    int rssi;
+    float snr;
 };
 
-#endif
\ No newline at end of file
+#endif
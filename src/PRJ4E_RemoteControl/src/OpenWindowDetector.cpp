@@ -0,0 +1,61 @@
+#include "OpenWindowDetector.h"
+
+OpenWindowDetector::OpenWindowDetector() : _start(0), _count(0), _open(false), _openedMs(0), _detections(0) {}
+
+void OpenWindowDetector::reset() {
+    clearSamples();
+    _open = false;
+}
+
+void OpenWindowDetector::clearSamples() {
+    _start = 0;
+    _count = 0;
+}
+
+bool OpenWindowDetector::isOpen() const {
+    return _open;
+}
+
+uint32_t OpenWindowDetector::detections() const {
+    return _detections;
+}
+
+bool OpenWindowDetector::addSample(uint32_t nowMs, float temp) {
+    if (_count < MAX_SAMPLES) {
+        _samples[(_start + _count) % MAX_SAMPLES] = {nowMs, temp};
+        _count++;
+    } else {
+        _samples[_start] = {nowMs, temp};
+        _start = (_start + 1) % MAX_SAMPLES;
+    }
+    while (_count > 1 && nowMs - _samples[_start].ms > WINDOW_MS) {
+        _start = (_start + 1) % MAX_SAMPLES;
+        _count--;
+    }
+
+    const Sample& oldest = _samples[_start];
+
+    if (!_open) {
+        float highest = temp;
+        for (size_t i = 0; i < _count; ++i) {
+            float t = _samples[(_start + i) % MAX_SAMPLES].temp;
+            if (t > highest) highest = t;
+        }
+        if (highest - temp >= DROP_C) {
+            _open = true;
+            _openedMs = nowMs;
+            _detections++;
+        }
+        return _open;
+    }
+
+    // Recover once the curve has flattened over a (nearly) full window
+    uint32_t held = nowMs - _openedMs;
+    bool fullWindow = nowMs - oldest.ms >= WINDOW_MS * 3 / 4;
+    bool stable = fullWindow && oldest.temp - temp <= STABLE_DROP_C;
+    if (held >= MAX_HOLD_MS || (held >= MIN_HOLD_MS && stable)) {
+        _open = false;
+        clearSamples();  // The drop must not trigger again right away
+    }
+    return _open;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Spots an opened window in the room temperature sample stream: a drop of
+// DROP_C within WINDOW_MS is far steeper than anything the radiator causes.
+// While the window is open the valve stays shut and normal control pauses,
+// for at least MIN_HOLD_MS and until the temperature stops falling (or
+// MAX_HOLD_MS at most). Reaction time is measured in test/test_open_window.
+class OpenWindowDetector {
+public:
+    OpenWindowDetector();
+
+    // Feed every room sample; returns true while the window counts as open
+    bool addSample(uint32_t nowMs, float temp);
+    bool isOpen() const;
+    uint32_t detections() const;
+    void reset();
+
+    static constexpr uint32_t WINDOW_MS = 60000;
+    static constexpr float DROP_C = 0.3f;          // Within WINDOW_MS
+    static constexpr float STABLE_DROP_C = 0.1f;  // Still "falling" above this per WINDOW_MS
+    static constexpr uint32_t MIN_HOLD_MS = 5UL * 60UL * 1000UL;
+    static constexpr uint32_t MAX_HOLD_MS = 30UL * 60UL * 1000UL;
+
+private:
+    struct Sample {
+        uint32_t ms;
+        float temp;
+    };
+
+    static constexpr size_t MAX_SAMPLES = 64;  // One WINDOW_MS at 1 s sampling
+
+    void clearSamples();
+
+    Sample _samples[MAX_SAMPLES];  // Ring buffer, oldest at _start
+    size_t _start;
+    size_t _count;
+    volatile bool _open;
+    uint32_t _openedMs;
+    uint32_t _detections;
+};
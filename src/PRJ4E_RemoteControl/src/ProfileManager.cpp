@@ -0,0 +1,45 @@
+#include "ProfileManager.h"
+
+static const char* NVS_NAMESPACE = "profile";
+static const char* NVS_KEY_INDEX = "index";
+
+// Comfort keeps the original 1 s / 10 s timing. The sensor period stays
+// short everywhere since that activity is not woken early on a change.
+static const RuntimeProfile PROFILES[ProfileManager::PROFILE_COUNT] = {
+    // name       sample  control  step  report  display
+    {"Comfort",   1000,   10000,   5,    10000,  60000},
+    {"Eco",       2000,   30000,   3,    30000,  15000},
+    {"Boost",     1000,   5000,    10,   5000,   120000},
+    {"Away",      5000,   60000,   2,    60000,  5000},
+};
+
+ProfileManager::ProfileManager(ActivityTask& activities) : _index(COMFORT), _activities(activities) {}
+
+void ProfileManager::begin() {
+    _prefs.begin(NVS_NAMESPACE, false);
+    int stored = _prefs.getUChar(NVS_KEY_INDEX, COMFORT);
+    _index = (stored < PROFILE_COUNT) ? stored : COMFORT;
+}
+
+const RuntimeProfile& ProfileManager::current() const {
+    return PROFILES[_index];
+}
+
+int ProfileManager::currentIndex() const {
+    return _index;
+}
+
+const RuntimeProfile& ProfileManager::get(int index) {
+    return PROFILES[(index >= 0 && index < PROFILE_COUNT) ? index : COMFORT];
+}
+
+void ProfileManager::select(int index) {
+    if (index < 0 || index >= PROFILE_COUNT || index == _index) return;
+    _index = index;
+    _prefs.putUChar(NVS_KEY_INDEX, index);
+    _activities.signal(ALL_LISTENERS);
+}
+
+void ProfileManager::wake(Listener listeners) {
+    _activities.signal(listeners);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "ActivityTask.h"
+
+// Settings bundled per runtime profile, picked on the "Mode" screen
+struct RuntimeProfile {
+    const char* name;
+    uint32_t samplePeriodMs;    // Temperature sensors
+    uint32_t controlPeriodMs;   // Valve control loop
+    int valveStep;              // Valve change per control cycle [%]
+    uint32_t reportIntervalMs;  // LoRa valve command or control report
+    uint32_t displayTimeoutMs;  // Display off without a button press
+};
+
+// Holds the active profile. Activities read it every cycle, so a new
+// selection applies without a reboot; activities with long periods wait on
+// their listener bit and are woken as soon as the profile changes.
+class ProfileManager {
+public:
+    enum Profile { COMFORT, ECO, BOOST, AWAY, PROFILE_COUNT };
+
+    // One activity event per activity that waits for a profile period
+    enum Listener { VALVE_ACTIVITY = 1 << 0, REPORT_ACTIVITY = 1 << 1,
+                    ALL_LISTENERS = VALVE_ACTIVITY | REPORT_ACTIVITY };
+
+    explicit ProfileManager(ActivityTask& activities);
+    void begin();  // Restores the last selection from NVS
+
+    const RuntimeProfile& current() const;
+    int currentIndex() const;
+    static const RuntimeProfile& get(int index);
+
+    void select(int index);  // Applies immediately and stores the choice
+
+    // Cuts a listener's wait short for events that cannot wait a full period
+    void wake(Listener listeners);
+
+private:
+    volatile int _index;
+    Preferences _prefs;  // Kept open, opening NVS allocates
+    ActivityTask& _activities;
+};
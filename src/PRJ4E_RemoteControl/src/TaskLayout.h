@@ -0,0 +1,25 @@
+#pragma once
+
+#include "TaskCreate.h"  // CREATE_TASK
+
+// Core and priority plan. Core 1 runs the activities (see Activity.h):
+// sensor sampling, the valve loop, radio, menu and temperature display, all
+// cooperatively on one stack. Core 0 takes the display flush, so I2C
+// transfers don't preempt a OneWire read. OneWire is not isolated from the
+// radio and flash work though, as the plan before the activities had it: a
+// sensor sample waits for a LittleFS write or a LoRa endPacket() that runs
+// ahead of it, and the menu and radio wait for a sample. Arduino's loop()
+// (serial commands) stays on core 1 at priority 1.
+#define CORE_ACTIVITIES 1
+#define CORE_DISPLAY    0
+
+// Priorities, higher preempts lower on the same core
+#define PRIO_DISPLAY_FLUSH 3  // Mostly waiting on the I2C interrupt
+#define PRIO_ACTIVITIES 2
+
+// Stack sizes in bytes. The activity stack is sized for the deepest body,
+// the valve loop's LittleFS writes. Not yet measured on a board: run
+// ttgo-lora-static through a trace rotation, history writes and radio
+// traffic, then replace these with the defines the MEM report ends with.
+#define STACK_DISPLAY_FLUSH 2048
+#define STACK_ACTIVITIES 4096
@@ -0,0 +1,103 @@
+#include "TemperatureSensors.h"
+
+static const char* NVS_NAMESPACE = "sensors";
+// NVS keys, also the names printed by printSensors()
+static const char* ROLE_KEYS[TemperatureSensors::ROLES] = {"room", "supply"};
+
+TemperatureSensors::TemperatureSensors(DallasTemperature& bus)
+    : _bus(bus), _persistent(false), _count(0), _conversionMs(750) {
+    for (uint8_t i = 0; i < MAX_SENSORS; ++i) _readings[i] = DEVICE_DISCONNECTED_C;
+    for (uint8_t r = 0; r < ROLES; ++r) _roleIndex[r] = NONE;
+}
+
+uint8_t TemperatureSensors::begin(uint8_t resolution) {
+    _bus.begin();
+    _persistent = _prefs.begin(NVS_NAMESPACE, false);
+
+    _count = 0;
+    uint8_t found = _bus.getDeviceCount();
+    for (uint8_t i = 0; i < found && _count < MAX_SENSORS; ++i) {
+        if (_bus.getAddress(_addresses[_count], i)) {
+            _bus.setResolution(_addresses[_count], resolution);
+            _count++;
+        }
+    }
+
+    // Conversions are started without blocking, the caller waits them out
+    _bus.setWaitForConversion(false);
+    _conversionMs = _bus.millisToWaitForConversion(resolution);
+
+    Serial.printf("Found %d temperature sensor(s)\n", _count);
+    resolveRoles();
+    if (_count > 0 && _roleIndex[ROOM] == NONE) {
+        Serial.println("No room sensor assigned, send \"SENSORS\" and \"SENSOR ROOM <n>\" on the serial port.");
+    }
+    return _count;
+}
+
+// Looks the stored addresses up among the sensors found
+void TemperatureSensors::resolveRoles() {
+    for (uint8_t r = 0; r < ROLES; ++r) {
+        DeviceAddress stored;
+        _roleIndex[r] = NONE;
+        if (!_persistent || _prefs.getBytes(ROLE_KEYS[r], stored, sizeof(stored)) != sizeof(stored)) continue;
+        for (uint8_t i = 0; i < _count; ++i) {
+            if (memcmp(stored, _addresses[i], sizeof(stored)) == 0) _roleIndex[r] = i;
+        }
+    }
+    if (_roleIndex[ROOM] == NONE && _count == 1 && _roleIndex[SUPPLY] != 0) _roleIndex[ROOM] = 0;
+}
+
+bool TemperatureSensors::assign(Role role, uint8_t index) {
+    if (role >= ROLES || index >= _count || !_persistent) return false;
+    _prefs.putBytes(ROLE_KEYS[role], _addresses[index], sizeof(DeviceAddress));
+    // One sensor can't measure both
+    for (uint8_t r = 0; r < ROLES; ++r) {
+        if (r != role && _roleIndex[r] == index) _prefs.remove(ROLE_KEYS[r]);
+    }
+    resolveRoles();
+    return true;
+}
+
+void TemperatureSensors::printSensors(Print& out) const {
+    for (uint8_t i = 0; i < _count; ++i) {
+        const uint8_t* a = _addresses[i];
+        out.printf("%u  %02X%02X%02X%02X%02X%02X%02X%02X  %6.2f C", i, a[0], a[1], a[2], a[3], a[4], a[5], a[6],
+                   a[7], _readings[i]);
+        for (uint8_t r = 0; r < ROLES; ++r) {
+            if (_roleIndex[r] == i) out.printf("  %s", ROLE_KEYS[r]);
+        }
+        out.println();
+    }
+}
+
+// Starts all conversions with one skip-ROM broadcast
+uint16_t TemperatureSensors::startConversion() {
+    if (_count == 0) return 0;
+    _bus.requestTemperatures();
+    return _conversionMs;
+}
+
+// Reads each sensor by its cached address
+void TemperatureSensors::readConversion() {
+    for (uint8_t i = 0; i < _count; ++i) {
+        _readings[i] = _bus.getTempC(_addresses[i]);
+    }
+}
+
+uint8_t TemperatureSensors::count() const {
+    return _count;
+}
+
+float TemperatureSensors::get(uint8_t index) const {
+    if (index >= _count) return DEVICE_DISCONNECTED_C;
+    return _readings[index];
+}
+
+float TemperatureSensors::room() const {
+    return get(_roleIndex[ROOM]);
+}
+
+float TemperatureSensors::supply() const {
+    return get(_roleIndex[SUPPLY]);
+}
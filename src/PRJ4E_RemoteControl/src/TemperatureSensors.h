@@ -0,0 +1,50 @@
+#pragma once
+
+#include <DallasTemperature.h>
+#include <Preferences.h>
+
+// All DS18B20s on the OneWire bus. Addresses are searched once in begin(),
+// after that every sample is one broadcast conversion for all sensors and a
+// direct read per address.
+//
+// The room sensor and the optional one on the radiator supply pipe are told
+// apart by ROM addresses stored in NVS, the search order only follows the
+// serial numbers. "SENSORS" on the serial port lists what was found and
+// "SENSOR ROOM <n>" / "SENSOR SUPPLY <n>" assigns a role. A single sensor
+// without a stored role is taken as the room sensor.
+class TemperatureSensors {
+public:
+    static constexpr uint8_t MAX_SENSORS = 4;
+    static constexpr uint8_t NONE = 0xFF;
+    enum Role : uint8_t { ROOM, SUPPLY, ROLES };
+
+    TemperatureSensors(DallasTemperature& bus);
+
+    uint8_t begin(uint8_t resolution = 12);
+
+    // A sample is a broadcast conversion, awaited by the caller, then a read.
+    // startConversion() returns the conversion time in ms, 0 without sensors.
+    uint16_t startConversion();
+    void readConversion();
+
+    uint8_t count() const;
+    float get(uint8_t index) const;  // DEVICE_DISCONNECTED_C if missing
+    float room() const;              // DEVICE_DISCONNECTED_C until assigned
+    float supply() const;
+
+    // Stores the address of sensor index for the role; false if out of range
+    bool assign(Role role, uint8_t index);
+    void printSensors(Print& out) const;
+
+private:
+    void resolveRoles();
+
+    DallasTemperature& _bus;
+    Preferences _prefs;  // Kept open, opening NVS allocates
+    bool _persistent;
+    DeviceAddress _addresses[MAX_SENSORS];
+    volatile float _readings[MAX_SENSORS];
+    uint8_t _count;
+    uint16_t _conversionMs;
+    volatile uint8_t _roleIndex[ROLES];  // Sensor index per role, NONE if not fitted
+};
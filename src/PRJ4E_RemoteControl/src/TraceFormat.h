@@ -0,0 +1,130 @@
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary controller trace, shared by TraceRecorder and the host replay.
+// A trace is a sequence of tagged little-endian entries:
+//   'S' session start  uint8 version, uint32 control period [ms]
+//   'R' control cycle  uint16 time since previous cycle [0.1 s],
+//                      float32 room temp [C], float32 target [C],
+//                      float32 supply temp [C] (NAN without supply sensor),
+//                      uint8 valve before update, uint8 valve after update,
+//                      uint8 flags
+//   'P' profile change uint8 valve step [%], uint32 control period [ms]
+//   'C' file continued uint8 version, uint32 control period [ms]; heads a
+//                      file reopened by rotation or TRACE CLEAR, so unlike
+//                      'S' the controller state carries over
+// Temperatures are kept bit-exact so the deadband decisions replay exactly.
+// Every session header carries the version its entries are written in:
+//   1  'R' is 14 bytes, without the supply temperature
+//   2  'R' is 18 bytes
+//   3  adds 'P'
+//   4  adds 'C'
+// TraceRecorder moves a file of another version to trace.old on boot, so a
+// file only mixes versions if it was written before that rule existed.
+namespace TraceFormat {
+
+const uint8_t TAG_SESSION = 'S';
+const uint8_t TAG_RECORD = 'R';
+const uint8_t TAG_PROFILE = 'P';
+const uint8_t TAG_CONTINUED = 'C';
+const uint8_t VERSION = 4;
+const uint8_t PROFILE_SINCE_VERSION = 3;  // 'P' in an older session is corruption
+
+const size_t SESSION_SIZE = 6;  // 'S' and 'C'
+const size_t RECORD_SIZE = 18;
+const size_t RECORD_SIZE_V1 = 14;
+const size_t PROFILE_SIZE = 6;
+
+inline bool isKnownVersion(uint8_t version) {
+    return version >= 1 && version <= VERSION;
+}
+
+inline size_t recordSize(uint8_t version) {
+    return version == 1 ? RECORD_SIZE_V1 : RECORD_SIZE;
+}
+
+const uint8_t FLAG_STALL = 0x01;        // A stall report was applied before this update
+const uint8_t FLAG_WINDOW_OPEN = 0x02;  // Control paused and valve shut, see OpenWindowDetector
+
+struct Record {
+    uint32_t dtDeciSeconds;
+    float temp;
+    float target;
+    float supply;
+    uint8_t valveBefore;
+    uint8_t valveAfter;
+    uint8_t flags;
+};
+
+inline void put16(uint8_t* p, int32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+}
+
+inline int16_t get16(const uint8_t* p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+inline void putFloat(uint8_t* p, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(bits >> (8 * i));
+}
+
+inline float getFloat(const uint8_t* p) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; ++i) bits |= (uint32_t)p[i] << (8 * i);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+inline bool isHeader(uint8_t tag) {
+    return tag == TAG_SESSION || tag == TAG_CONTINUED;
+}
+
+inline void encodeSession(uint8_t* out, uint32_t periodMs, uint8_t tag = TAG_SESSION) {
+    out[0] = tag;
+    out[1] = VERSION;
+    for (int i = 0; i < 4; ++i) out[2 + i] = (uint8_t)(periodMs >> (8 * i));
+}
+
+inline void encodeProfile(uint8_t* out, uint8_t valveStep, uint32_t periodMs) {
+    out[0] = TAG_PROFILE;
+    out[1] = valveStep;
+    for (int i = 0; i < 4; ++i) out[2 + i] = (uint8_t)(periodMs >> (8 * i));
+}
+
+inline void encodeRecord(uint8_t* out, const Record& r) {
+    uint32_t dt = r.dtDeciSeconds > 0xFFFF ? 0xFFFF : r.dtDeciSeconds;
+    out[0] = TAG_RECORD;
+    put16(out + 1, dt);
+    putFloat(out + 3, r.temp);
+    putFloat(out + 7, r.target);
+    putFloat(out + 11, r.supply);
+    out[15] = r.valveBefore;
+    out[16] = r.valveAfter;
+    out[17] = r.flags;
+}
+
+// An 'R' entry of recordSize(version) bytes
+inline void decodeRecord(const uint8_t* in, uint8_t version, Record& r) {
+    r.dtDeciSeconds = (uint16_t)get16(in + 1);
+    r.temp = getFloat(in + 3);
+    r.target = getFloat(in + 7);
+    size_t tail = 11;
+    if (version == 1) {
+        r.supply = NAN;
+    } else {
+        r.supply = getFloat(in + 11);
+        tail += 4;
+    }
+    r.valveBefore = in[tail];
+    r.valveAfter = in[tail + 1];
+    r.flags = in[tail + 2];
+}
+
+}  // namespace TraceFormat
@@ -0,0 +1,150 @@
+#include "TraceRecorder.h"
+#include <LittleFS.h>
+
+static const char* TRACE_PATH = "/trace.bin";
+static const char* TRACE_OLD_PATH = "/trace.old";
+
+TraceRecorder::TraceRecorder() : _mutex(NULL), _ready(false), _lastRecordMs(0), _periodMs(0), _unflushed(0) {
+    memset(_profile, 0, sizeof(_profile));
+}
+
+bool TraceRecorder::begin(uint32_t controlPeriodMs) {
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    if (!LittleFS.begin(true)) {
+        Serial.println("LittleFS mount failed, trace recording disabled.");
+        return false;
+    }
+
+    // Entries are only appended in this firmware's layout; a file from another
+    // version is kept as trace.old, see TraceFormat.h
+    File existing = LittleFS.open(TRACE_PATH, FILE_READ);
+    if (existing) {
+        uint8_t header[2] = {0, 0};
+        bool stale = existing.size() > 0 && (existing.read(header, sizeof(header)) != sizeof(header) ||
+                                             !TraceFormat::isHeader(header[0]) ||
+                                             header[1] != TraceFormat::VERSION);
+        existing.close();
+        if (stale) {
+            Serial.printf("Trace version %u moved to %s\n", header[1], TRACE_OLD_PATH);
+            LittleFS.remove(TRACE_OLD_PATH);
+            LittleFS.rename(TRACE_PATH, TRACE_OLD_PATH);
+        }
+    }
+
+    _file = LittleFS.open(TRACE_PATH, FILE_APPEND);
+    if (!_file) return false;
+    _ready = true;
+    _lastRecordMs = millis();
+    _periodMs = controlPeriodMs;
+
+    uint8_t session[TraceFormat::SESSION_SIZE];
+    TraceFormat::encodeSession(session, controlPeriodMs);
+    return append(session, sizeof(session));
+}
+
+void TraceRecorder::recordProfile(int valveStep, uint32_t controlPeriodMs) {
+    if (!_ready) return;
+
+    uint8_t entry[TraceFormat::PROFILE_SIZE];
+    TraceFormat::encodeProfile(entry, valveStep, controlPeriodMs);
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    memcpy(_profile, entry, sizeof(entry));
+    _periodMs = controlPeriodMs;
+    xSemaphoreGive(_mutex);
+    append(entry, sizeof(entry));
+}
+
+void TraceRecorder::record(float temp, float target, float supply, int valveBefore, int valveAfter, bool stallApplied,
+                           bool windowOpen) {
+    if (!_ready) return;
+
+    unsigned long now = millis();
+    TraceFormat::Record r;
+    r.dtDeciSeconds = (now - _lastRecordMs) / 100;
+    r.temp = temp;
+    r.target = target;
+    r.supply = supply;
+    r.valveBefore = valveBefore;
+    r.valveAfter = valveAfter;
+    r.flags = (stallApplied ? TraceFormat::FLAG_STALL : 0) | (windowOpen ? TraceFormat::FLAG_WINDOW_OPEN : 0);
+    _lastRecordMs = now;
+
+    uint8_t entry[TraceFormat::RECORD_SIZE];
+    TraceFormat::encodeRecord(entry, r);
+    append(entry, sizeof(entry));
+}
+
+bool TraceRecorder::append(const uint8_t* data, size_t len) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    bool ok = _file.write(data, len) == len;
+    if (++_unflushed >= FLUSH_ENTRIES) {
+        _file.flush();
+        _unflushed = 0;
+    }
+
+    // Rotation reopens the file, about once every two days of recording
+    if (_file.size() > MAX_FILE_SIZE) {
+        _file.close();
+        LittleFS.remove(TRACE_OLD_PATH);
+        LittleFS.rename(TRACE_PATH, TRACE_OLD_PATH);
+        reopen();
+    }
+    xSemaphoreGive(_mutex);
+    return ok;
+}
+
+// With _mutex held. Writes the header itself, append() would take the mutex
+// again; the new file has to start with one or begin() takes it for stale.
+void TraceRecorder::reopen() {
+    _file = LittleFS.open(TRACE_PATH, FILE_APPEND);
+    _ready = (bool)_file;
+    if (!_ready) return;
+
+    uint8_t header[TraceFormat::SESSION_SIZE];
+    TraceFormat::encodeSession(header, _periodMs, TraceFormat::TAG_CONTINUED);
+    _file.write(header, sizeof(header));
+    if (_profile[0] == TraceFormat::TAG_PROFILE) _file.write(_profile, sizeof(_profile));
+    _file.flush();
+    _unflushed = 0;
+}
+
+void TraceRecorder::dump(Print& out) {
+    if (!_ready) return;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _file.flush();
+    _unflushed = 0;
+    dumpFile(TRACE_OLD_PATH, out);
+    dumpFile(TRACE_PATH, out);
+    xSemaphoreGive(_mutex);
+    out.println("TRACE:END");
+}
+
+void TraceRecorder::dumpFile(const char* path, Print& out) {
+    File file = LittleFS.open(path, FILE_READ);
+    if (!file) return;
+
+    static const char hex[] = "0123456789abcdef";
+    uint8_t buf[32];
+    char line[6 + 2 * sizeof(buf) + 1];
+    size_t n;
+    while ((n = file.read(buf, sizeof(buf))) > 0) {
+        memcpy(line, "TRACE:", 6);
+        for (size_t i = 0; i < n; ++i) {
+            line[6 + 2 * i] = hex[buf[i] >> 4];
+            line[7 + 2 * i] = hex[buf[i] & 0x0F];
+        }
+        line[6 + 2 * n] = '\0';
+        out.println(line);
+    }
+    file.close();
+}
+
+void TraceRecorder::clear() {
+    if (!_ready) return;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _file.close();
+    LittleFS.remove(TRACE_OLD_PATH);
+    LittleFS.remove(TRACE_PATH);
+    reopen();
+    xSemaphoreGive(_mutex);
+}
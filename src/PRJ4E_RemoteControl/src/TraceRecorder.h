@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "TraceFormat.h"
+
+// Appends every valve control cycle to a binary trace on LittleFS so a
+// misbehaving room can be replayed on the host (test/test_trace_replay).
+class TraceRecorder {
+public:
+    TraceRecorder();
+
+    bool begin(uint32_t controlPeriodMs);
+    void recordProfile(int valveStep, uint32_t controlPeriodMs);
+    void record(float temp, float target, float supply, int valveBefore, int valveAfter, bool stallApplied,
+                bool windowOpen);
+
+    // Hex dump as "TRACE:<hex>" lines, oldest file first
+    void dump(Print& out);
+    void clear();
+
+private:
+    static constexpr size_t MAX_FILE_SIZE = 256 * 1024;  // Rotated to trace.old
+    // Entries between flushes, what a reset loses at most: 5 min in Comfort
+    static constexpr int FLUSH_ENTRIES = 30;
+
+    bool append(const uint8_t* data, size_t len);
+    void reopen();
+    void dumpFile(const char* path, Print& out);
+
+    File _file;  // Kept open, opening a file allocates
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+    bool _ready;
+    unsigned long _lastRecordMs;
+    uint32_t _periodMs;                           // For the header of a reopened file
+    uint8_t _profile[TraceFormat::PROFILE_SIZE];  // Last 'P' entry, repeated after the header
+    int _unflushed;
+};
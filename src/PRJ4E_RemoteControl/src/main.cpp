@@ -6,6 +6,16 @@
 #include "ValveController.h"
 #include "TemperatureManager.h"
 #include "LoRaDevice.h"
+#include "LoRaProtocol.h"
+#include "TraceRecorder.h"
+#include "TemperatureSensors.h"
+#include "TaskLayout.h"
+#include "JitterStats.h"
+#include "ProfileManager.h"
+#include "OpenWindowDetector.h"
+#include "AsyncSSD1306.h"
+#include "HistoryStore.h"
+#include "ActivityTask.h"
 
 // Pin setup
 #define ONE_WIRE_BUS 13
@@ -13,128 +23,504 @@
 #define BUTTON_UP    17
 #define BUTTON_DOWN  16
 
+// Set to 1 to run the valve loop on the motor controller. The remote then
+// only reports setpoint and room temperature ("CTRL:" frames).
+#ifndef CONTROL_ON_ACTUATOR
+#define CONTROL_ON_ACTUATOR 0
+#endif
+
+// Fast mode, the highest clock in the SSD1306 datasheet. Many modules run
+// at 1 MHz too (-DDISPLAY_I2C_HZ=1000000UL in build_flags), check the panel
+// for noise and the "DISPLAY" failure count before keeping that.
+#ifndef DISPLAY_I2C_HZ
+#define DISPLAY_I2C_HZ 400000UL
+#endif
+
+// CTRL: frames go out on a temperature change or as a heartbeat
+#define CTRL_TEMP_DELTA      0.1f
+#define CTRL_HEARTBEAT_MS    (10UL * 60UL * 1000UL)
+
 // Globals
 OneWire oneWire(ONE_WIRE_BUS);
 DallasTemperature sensors(&oneWire);
-U8G2_SSD1306_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, U8X8_PIN_NONE);
+TemperatureSensors tempSensors(sensors);
+AsyncSSD1306 u8g2(U8G2_R0);  // sendBuffer() returns before the bus transfer, see AsyncSSD1306.h
 DisplayManager display(u8g2);
 ValveController valveController;
 TemperatureManager tempManager;
 LoRaDevice loraDevice;
+TraceRecorder traceRecorder;
+HistoryStore history;  // Minute, hour and day tiers for the History screen
+ActivityTask activities;  // Everything but the display flush, see Activity.h
+ProfileManager profiles(activities);  // Sample, control and report timing, see ProfileManager.h
+OpenWindowDetector windowDetector;
+
+// Latest actuator report, handed from the LoRa receive activity to the valve activity
+QueueHandle_t actuatorStatusQueue;
+static StaticQueue_t actuatorStatusQueueBuffer;
+static uint8_t actuatorStatusStorage[sizeof(ActuatorStatus)];
+volatile int confirmedValvePosition = -1;  // Target the actuator last confirmed
+
+// History screen ranges, Up/Down steps through them
+static const HistoryStore::Tier graphTiers[] = {HistoryStore::MINUTE, HistoryStore::HOUR, HistoryStore::DAY};
+static const char* const graphTitles[] = {"Last 96 min", "Last 4 days", "Last 96 days"};
+static const int GRAPH_RANGES = sizeof(graphTiers) / sizeof(graphTiers[0]);
+static HistoryFormat::Sample graphSamples[DisplayManager::GRAPH_POINTS];
+
+// Sample timing, reported with -DJITTER_REPORT
+JitterStats sampleJitter("Sample", 1000000UL);
+
+// Activity events, see Activity.h. The profile wake-ups are ProfileManager's listener bits.
+enum : ActivityEvents {
+    EVENT_VALVE_WAKE = ProfileManager::VALVE_ACTIVITY,
+    EVENT_REPORT_WAKE = ProfileManager::REPORT_ACTIVITY,
+    EVENT_BUTTON = 1 << 2,
+    EVENT_RADIO = 1 << 3,
+};
+
+#define MENU_TICK_MS         100   // Blink and display timeout without a press
+#define BUTTON_DEBOUNCE_MS   20
+#define RADIO_POLL_MS        1000  // In case a DIO0 edge is missed
+#define SENSOR_RETRY_MS      5000  // Valve loop without a room temperature
+
+void IRAM_ATTR onButtonEdge() {
+    activities.signalFromISR(EVENT_BUTTON);
+}
+
+void IRAM_ATTR onRadioPacket() {
+    activities.signalFromISR(EVENT_RADIO);
+}
 
 // FreeRTOS tasks
-void TaskTemperatureDisplay(void* pvParameters) {
-    for (;;) {
-        sensors.requestTemperatures();
-        float tempC = sensors.getTempCByIndex(0);
-        display.updateTemperature(tempC);
-        display.updateSetTempScreen(tempC);
-        vTaskDelay(pdMS_TO_TICKS(1000));
+void TaskDisplayFlush(void* pvParameters) {
+    u8g2.runFlush();
+}
+
+void TaskActivities(void* pvParameters) {
+    activities.run();
+}
+
+// Activities
+class SensorActivity : public Activity {
+public:
+    SensorActivity() : Activity("Sensor"), _periodMs(0), _nextMs(0) {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        _nextMs = now();
+        for (;;) {
+            if (profiles.current().samplePeriodMs != _periodMs) {
+                _periodMs = profiles.current().samplePeriodMs;
+                sampleJitter.setPeriod(_periodMs * 1000UL);
+            }
+            sampleJitter.tick();
+            ACTIVITY_SLEEP(tempSensors.startConversion());
+            tempSensors.readConversion();
+            checkWindow();
+
+            _nextMs += _periodMs;
+            ACTIVITY_SLEEP_UNTIL(_nextMs);
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    // Checked on every sample, so an open window doesn't wait for the control period
+    void checkWindow() {
+        float roomTemp = tempSensors.room();
+        if (roomTemp == DEVICE_DISCONNECTED_C) return;
+        bool wasOpen = windowDetector.isOpen();
+        if (windowDetector.addSample(millis(), roomTemp) != wasOpen) {
+            Serial.println(wasOpen ? "Window closed, resuming valve control" : "Window open, shutting valve");
+            profiles.wake(ProfileManager::ALL_LISTENERS);
+        }
+    }
+
+    uint32_t _periodMs;
+    uint32_t _nextMs;
+};
+
+class TemperatureDisplayActivity : public Activity {
+public:
+    TemperatureDisplayActivity() : Activity("TempDisplay") {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            display.updateTemperature(tempSensors.room());
+            display.updateSetTempScreen(tempSensors.room());
+            ACTIVITY_SLEEP(1000);
+        }
+        ACTIVITY_END();
     }
+};
+
+static void showHistory(int range) {
+    size_t count = history.query(graphTiers[range], graphSamples, DisplayManager::GRAPH_POINTS);
+    display.goToGraphScreen(graphSamples, count, graphTitles[range]);
 }
 
-void TaskMenuNavigation(void* pvParameters) {
-    bool lastMenu = HIGH, lastUp = HIGH, lastDown = HIGH;
-    for (;;) {
+// Woken by a button edge, read once the contacts have settled
+class MenuActivity : public Activity {
+public:
+    MenuActivity()
+        : Activity("Menu"), _lastMenu(HIGH), _lastUp(HIGH), _lastDown(HIGH), _lastPressMs(0), _graphRange(0) {
+        for (int i = 0; i < ProfileManager::PROFILE_COUNT; ++i) _modeNames[i] = ProfileManager::get(i).name;
+    }
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        _lastPressMs = now();
+        for (;;) {
+            ACTIVITY_WAIT(EVENT_BUTTON, MENU_TICK_MS);
+            if (woken()) ACTIVITY_SLEEP(BUTTON_DEBOUNCE_MS);
+            readButtons();
+            display.tickBlink();
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    void readButtons() {
         bool menu = digitalRead(BUTTON_MENU);
         bool up = digitalRead(BUTTON_UP);
         bool down = digitalRead(BUTTON_DOWN);
 
-        if (menu == LOW && lastMenu == HIGH) {
+        bool menuPressed = menu == LOW && _lastMenu == HIGH;
+        bool upPressed = up == LOW && _lastUp == HIGH;
+        bool downPressed = down == LOW && _lastDown == HIGH;
+
+        if (menuPressed || upPressed || downPressed) {
+            _lastPressMs = millis();
+            // The first press only turns the display back on
+            if (display.isAsleep()) {
+                display.wake();
+                menuPressed = upPressed = downPressed = false;
+            }
+        } else if (!display.isAsleep() && millis() - _lastPressMs > profiles.current().displayTimeoutMs) {
+            display.sleep();
+        }
+
+        if (menuPressed) {
             if (display.isMenuScreen()) {
                 int index = display.getSelectedIndex();
                 if (index == 0) display.goToTempScreen();
                 else if (index == 1) display.goToSetTempScreen();
-                // else Mode option
+                else if (index == 2) display.goToModeScreen(_modeNames, ProfileManager::PROFILE_COUNT, profiles.currentIndex());
+                else showHistory(_graphRange = 0);
             } else if (display.isSetTempScreen()) {
                 if (display.confirmSetTemp()) display.goToMenuScreen();
+            } else if (display.isModeScreen()) {
+                profiles.select(display.getSelectedMode());
+                Serial.printf("Mode: %s\n", profiles.current().name);
+                display.goToMenuScreen();
             } else {
                 display.goToMenuScreen();
             }
         }
 
-        if (up == LOW && lastUp == HIGH) {
-            if (display.isMenuScreen()) display.moveSelection(-1);
+        if (upPressed) {
+            if (display.isMenuScreen() || display.isModeScreen()) display.moveSelection(-1);
             else if (display.isSetTempScreen()) display.increaseTargetTemp();
+            else if (display.isGraphScreen()) showHistory(_graphRange = (_graphRange + GRAPH_RANGES - 1) % GRAPH_RANGES);
         }
 
-        if (down == LOW && lastDown == HIGH) {
-            if (display.isMenuScreen()) display.moveSelection(1);
+        if (downPressed) {
+            if (display.isMenuScreen() || display.isModeScreen()) display.moveSelection(1);
             else if (display.isSetTempScreen()) display.decreaseTargetTemp();
+            else if (display.isGraphScreen()) showHistory(_graphRange = (_graphRange + 1) % GRAPH_RANGES);
         }
 
-        lastMenu = menu;
-        lastUp = up;
-        lastDown = down;
+        _lastMenu = menu;
+        _lastUp = up;
+        _lastDown = down;
+    }
+
+    const char* _modeNames[ProfileManager::PROFILE_COUNT];
+    bool _lastMenu, _lastUp, _lastDown;
+    unsigned long _lastPressMs;
+    int _graphRange;
+};
+
+class ValveControlActivity : public Activity {
+public:
+    ValveControlActivity() : Activity("ValveControl"), _profileIndex(-1) {}
 
-        display.tickBlink();
-        vTaskDelay(pdMS_TO_TICKS(50));
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            ACTIVITY_WAIT(EVENT_VALVE_WAKE, controlCycle());
+        }
+        ACTIVITY_END();
     }
-}
 
-void TaskValveControl(void* pvParameters) {
-    for (;;) {
-        sensors.requestTemperatures();
-        vTaskDelay(pdMS_TO_TICKS(750));  // Wait for sensor to finish conversion
+private:
+    // Returns the ms until the next cycle
+    uint32_t controlCycle() {
+        const RuntimeProfile& profile = profiles.current();
+        if (profiles.currentIndex() != _profileIndex) {
+            _profileIndex = profiles.currentIndex();
+            valveController.setStepSize(profile.valveStep);
+            traceRecorder.recordProfile(profile.valveStep, profile.controlPeriodMs);
+        }
 
-        float currentTemp = sensors.getTempCByIndex(0);
+        float currentTemp = tempSensors.room();
+        float supplyTemp = tempSensors.supply();
+        if (supplyTemp == DEVICE_DISCONNECTED_C) supplyTemp = NAN;
 
         if (currentTemp == DEVICE_DISCONNECTED_C) {
             Serial.println("Temperature sensor disconnected! Skipping valve update.");
-            vTaskDelay(pdMS_TO_TICKS(5000));
-            continue;
+            return SENSOR_RETRY_MS;
         }
 
         float targetTemp = display.getTargetTemp();
 
+        bool stallApplied = false;
+        ActuatorStatus status;
+        if (xQueueReceive(actuatorStatusQueue, &status, 0) == pdTRUE) {
+            valveController.applyActuatorStatus(status.actualPercent, status.stalled);
+            stallApplied = status.stalled;
+        }
+
+        bool windowOpen = windowDetector.isOpen();
         valveController.recordTemperature(currentTemp);
-        valveController.update(currentTemp, targetTemp);
+        int valveBefore = valveController.getValvePosition();
+        if (windowOpen) valveController.setValvePosition(0);  // Control paused, see OpenWindowDetector.h
+        else valveController.update(currentTemp, targetTemp, supplyTemp);
+        int valveAfter = valveController.getValvePosition();
+
+        traceRecorder.record(currentTemp, targetTemp, supplyTemp, valveBefore, valveAfter, stallApplied, windowOpen);
+        history.add(millis(), currentTemp, targetTemp, valveAfter);
+
+        // Send the close command now rather than after the report interval
+        if (valveAfter != valveBefore && windowOpen) profiles.wake(ProfileManager::REPORT_ACTIVITY);
 
         Serial.print("Current Temp: ");
         Serial.print(currentTemp, 1);
         Serial.print(" C, Target: ");
         Serial.print(targetTemp, 1);
         Serial.print(" C, Valve: ");
+        Serial.println(valveAfter);
 
-        vTaskDelay(pdMS_TO_TICKS(10000));
+        return profile.controlPeriodMs;
     }
-}
 
-void TaskLoRaSend(void *pvParameters) {
-  float valvePosition = 0.0f;
-  for (;;) {
-    // Format payload
-    valvePosition = valveController.getValvePosition();
-    char payload[16];
-    snprintf(payload, sizeof(payload), "VALVE:%.2f", valvePosition);
+    int _profileIndex;
+};
 
-    LoRa.beginPacket();
-    LoRa.print(payload);
-    LoRa.endPacket();
+class LoRaSendActivity : public Activity {
+public:
+    LoRaSendActivity() : Activity("LoRaSend") {}
 
-    Serial.printf("Sent valve position: %.2f\n", valvePosition);
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            sendValvePosition();
+            ACTIVITY_WAIT(EVENT_REPORT_WAKE, profiles.current().reportIntervalMs);
+        }
+        ACTIVITY_END();
+    }
 
-    vTaskDelay(pdMS_TO_TICKS(10000)); 
-  }
-}
+private:
+    void sendValvePosition() {
+        float valvePosition = valveController.getValvePosition();
+
+        // Resend until the actuator confirms it reached this position
+        if ((int)valvePosition != confirmedValvePosition) {
+            char payload[16];
+            formatValveCommand(payload, sizeof(payload), valvePosition);
+            loraDevice.send(payload);
+
+            Serial.printf("Sent valve position: %.2f\n", valvePosition);
+        }
+    }
+};
+
+class ControlReportActivity : public Activity {
+public:
+    ControlReportActivity()
+        : Activity("ControlReport"), _lastSentTemp(DEVICE_DISCONNECTED_C), _lastSentTarget(-1.0f), _lastSentMs(0) {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            report();
+            ACTIVITY_WAIT(EVENT_REPORT_WAKE, profiles.current().reportIntervalMs);
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    void report() {
+        float roomTemp = tempSensors.room();
+        float targetTemp = display.getTargetTemp();
+
+        if (windowDetector.isOpen()) {
+            // A VALVE: frame makes the motor drop local control; resend until confirmed
+            if (confirmedValvePosition != 0) {
+                char payload[16];
+                formatValveCommand(payload, sizeof(payload), 0);
+                loraDevice.send(payload);
+                Serial.println("Window open, sent valve close");
+            }
+            _lastSentMs = 0;  // A CTRL frame hands control back as soon as it closes
+        } else if (roomTemp != DEVICE_DISCONNECTED_C) {
+            history.add(millis(), roomTemp, targetTemp, confirmedValvePosition);  // -1 (unconfirmed) counts as shut
+
+            bool changed = targetTemp != _lastSentTarget || fabs(roomTemp - _lastSentTemp) >= CTRL_TEMP_DELTA;
+            bool heartbeat = millis() - _lastSentMs >= CTRL_HEARTBEAT_MS;
 
+            if (changed || heartbeat || _lastSentMs == 0) {
+                float supplyTemp = tempSensors.supply();
+                if (supplyTemp == DEVICE_DISCONNECTED_C) supplyTemp = NAN;
 
+                char payload[32];
+                formatControlReport(payload, sizeof(payload), targetTemp, roomTemp, supplyTemp);
+                loraDevice.send(payload);
+
+                _lastSentTemp = roomTemp;
+                _lastSentTarget = targetTemp;
+                _lastSentMs = millis();
+                Serial.printf("Sent control report: %s\n", payload);
+            }
+        }
+    }
+
+    float _lastSentTemp;
+    float _lastSentTarget;
+    unsigned long _lastSentMs;
+};
+
+// Woken by the radio's DIO0 interrupt, see LoRaDevice::listen()
+class LoRaReceiveActivity : public Activity {
+public:
+    LoRaReceiveActivity() : Activity("LoRaRecv"), _stalledAxes(0) {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            ACTIVITY_WAIT(EVENT_RADIO, RADIO_POLL_MS);
+            receiveStatus();
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    void receiveStatus() {
+        char payload[64 + FrameAuth::OVERHEAD];
+        if (loraDevice.receive(payload, sizeof(payload)) == 0) return;
+
+        ActuatorStatus status;
+        if (!ActuatorStatus::parse(payload, status)) return;
+
+        // The controller drives valve 0, further valves only follow it
+        if (status.axis == 0) {
+            confirmedValvePosition = status.stalled ? -1 : status.targetPercent;
+            xQueueOverwrite(actuatorStatusQueue, &status);
+        }
+        if (status.stalled) _stalledAxes |= 1 << status.axis;
+        else _stalledAxes &= ~(1 << status.axis);
+
+        // Show the weaker direction of the link
+        display.updateLinkStatus(min(status.rssi, loraDevice.lastRssi()), _stalledAxes != 0);
+
+        Serial.printf("Actuator %d: %d%% (target %d%%), stall=%d, peak=%d mA, rssi=%d/%d, move=%d mJ, total=%lu J%s\n",
+                      status.axis, status.actualPercent, status.targetPercent, status.stalled,
+                      status.peakCurrent_mA, status.rssi, loraDevice.lastRssi(),
+                      status.moveEnergy_mJ, status.totalEnergy_J, status.seizing ? ", seizing" : "");
+    }
+
+    uint8_t _stalledAxes;  // Bit per valve of a multi-valve actuator
+};
+
+SensorActivity sensorActivity;
+TemperatureDisplayActivity temperatureDisplayActivity;
+MenuActivity menuActivity;
+#if CONTROL_ON_ACTUATOR
+ControlReportActivity controlReportActivity;
+#else
+ValveControlActivity valveControlActivity;
+LoRaSendActivity loraSendActivity;
+#endif
+LoRaReceiveActivity loraReceiveActivity;
 
 void setup() {
     Serial.begin(115200);
-    sensors.begin();
+    tempSensors.begin();
+    u8g2.beginBus(SDA, SCL, DISPLAY_I2C_HZ);
     display.init();
 
     pinMode(BUTTON_MENU, INPUT_PULLUP);
     pinMode(BUTTON_UP, INPUT_PULLUP);
     pinMode(BUTTON_DOWN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(BUTTON_MENU), onButtonEdge, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(BUTTON_UP), onButtonEdge, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(BUTTON_DOWN), onButtonEdge, CHANGE);
     loraDevice.begin(868E6);
+    loraDevice.listen(onRadioPacket);
+    actuatorStatusQueue = xQueueCreateStatic(1, sizeof(ActuatorStatus), actuatorStatusStorage,
+                                             &actuatorStatusQueueBuffer);
+    profiles.begin();
+    traceRecorder.begin(profiles.current().controlPeriodMs);
+    history.begin();
+
+
+    activities.add(sensorActivity);
+    activities.add(temperatureDisplayActivity);
+    activities.add(menuActivity);
+#if CONTROL_ON_ACTUATOR
+    activities.add(controlReportActivity);
+#else
+    activities.add(valveControlActivity);
+    activities.add(loraSendActivity);
+#endif
+    activities.add(loraReceiveActivity);
 
+    // See TaskLayout.h for the core and priority plan
+    CREATE_TASK(TaskActivities, "Activities", STACK_ACTIVITIES, PRIO_ACTIVITIES, CORE_ACTIVITIES);
+    CREATE_TASK(TaskDisplayFlush, "DisplayFlush", STACK_DISPLAY_FLUSH, PRIO_DISPLAY_FLUSH, CORE_DISPLAY);
 
-    xTaskCreate(TaskTemperatureDisplay, "TempTask", 4096, NULL, 1, NULL);
-    xTaskCreate(TaskMenuNavigation, "MenuNav", 4096, NULL, 2, NULL);
-    xTaskCreate(TaskValveControl, "ValveControl", 4096, NULL, 1, NULL);
-    xTaskCreate(TaskLoRaSend, "LoRa Send Task", 2048, NULL, 1, NULL);
+    // Everything is allocated, see MemoryGuard.h
+    MemoryGuard::lockHeap();
 }
 
-void loop() {}
\ No newline at end of file
+void loop() {
+    // Serial commands: "TRACE" dumps the controller trace, "TRACE CLEAR" deletes it,
+    // "MEM" prints stack and heap usage, "KEY <32 hex digits>" sets the LoRa key,
+    // "DISPLAY" prints the display flush times, "ACT" the activity run counts,
+    // "SENSORS" lists the temperature sensors, "SENSOR ROOM|SUPPLY <n>" assigns one
+    if (Serial.available()) {
+        char line[48];
+        size_t len = Serial.readBytesUntil('\n', line, sizeof(line) - 1);
+        while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+        line[len] = '\0';
+        if (strcmp(line, "TRACE") == 0) traceRecorder.dump(Serial);
+        else if (strcmp(line, "TRACE CLEAR") == 0) traceRecorder.clear();
+        else if (strcmp(line, "MEM") == 0) MemoryGuard::printReport(Serial);
+        else if (strcmp(line, "DISPLAY") == 0)
+            Serial.printf("Display flush: last %lu us, max %lu us, %lu flushes, %lu failed\n",
+                          (unsigned long)u8g2.lastFlushUs(), (unsigned long)u8g2.maxFlushUs(),
+                          (unsigned long)u8g2.flushCount(), (unsigned long)u8g2.failedFlushes());
+        else if (strcmp(line, "ACT") == 0) {
+            for (const Activity* a = activities.first(); a; a = a->next())
+                Serial.printf("%-14s %lu runs%s\n", a->name(), (unsigned long)a->runs(), a->finished() ? ", finished" : "");
+        }
+        else if (strcmp(line, "SENSORS") == 0) tempSensors.printSensors(Serial);
+        else if (strncmp(line, "SENSOR ROOM ", 12) == 0)
+            Serial.println(tempSensors.assign(TemperatureSensors::ROOM, atoi(line + 12)) ? "Room sensor stored"
+                                                                                          : "No such sensor");
+        else if (strncmp(line, "SENSOR SUPPLY ", 14) == 0)
+            Serial.println(tempSensors.assign(TemperatureSensors::SUPPLY, atoi(line + 14)) ? "Supply sensor stored"
+                                                                                            : "No such sensor");
+        else if (strncmp(line, "KEY ", 4) == 0)
+            Serial.println(loraDevice.provisionKey(line + 4) ? "LoRa key stored" : "Invalid LoRa key");
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+}
\ No newline at end of file
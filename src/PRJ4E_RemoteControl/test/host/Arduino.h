@@ -0,0 +1,55 @@
+#pragma once
+// Just enough of Arduino.h to build the display, control and trace code on
+// the host
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline unsigned long millis() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Print and Serial; a test captures output by implementing write()
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t println(const char* text = "") { return print(text) + print("\r\n"); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        return print(buf);
+    }
+};
+
+class HostSerial : public Print {
+public:
+    size_t write(const uint8_t* data, size_t len) override { return fwrite(data, 1, len, stdout); }
+};
+
+inline HostSerial Serial;
+
+// FreeRTOS mutexes, the host tests are single-threaded
+typedef void* SemaphoreHandle_t;
+struct StaticSemaphore_t {};
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdTRUE 1
+
+inline SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) { return buffer; }
+inline int xSemaphoreTake(SemaphoreHandle_t, uint32_t) { return pdTRUE; }
+inline int xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
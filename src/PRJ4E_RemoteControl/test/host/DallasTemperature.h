@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in, only the sentinel value is used outside the sensor code
+#define DEVICE_DISCONNECTED_C -127
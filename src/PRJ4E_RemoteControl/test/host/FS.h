@@ -0,0 +1,41 @@
+#pragma once
+// In-memory stand-in for the ESP32 FS File, enough for TraceRecorder
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_APPEND "a"
+
+class File {
+public:
+    typedef std::shared_ptr<std::vector<uint8_t>> Data;
+
+    File() : _pos(0) {}
+    explicit File(const Data& data) : _data(data), _pos(0) {}
+
+    explicit operator bool() const { return (bool)_data; }
+
+    // Appends, every handle of a path shares its data
+    size_t write(const uint8_t* data, size_t len) {
+        if (!_data) return 0;
+        _data->insert(_data->end(), data, data + len);
+        return len;
+    }
+
+    size_t read(uint8_t* buf, size_t len) {
+        if (!_data || _pos >= _data->size()) return 0;
+        size_t n = std::min(len, _data->size() - _pos);
+        memcpy(buf, _data->data() + _pos, n);
+        _pos += n;
+        return n;
+    }
+
+    size_t size() const { return _data ? _data->size() : 0; }
+    void flush() {}
+    void close() { _data.reset(); }
+
+private:
+    Data _data;
+    size_t _pos;
+};
@@ -0,0 +1,37 @@
+#pragma once
+// In-memory LittleFS. clearAll() formats it, for a test's setUp().
+#include <FS.h>
+#include <map>
+#include <string>
+
+class HostLittleFS {
+public:
+    bool begin(bool formatOnFail = false) { return true; }
+
+    File open(const char* path, const char* mode = FILE_READ) {
+        auto it = _files.find(path);
+        if (it == _files.end()) {
+            if (mode[0] == 'r') return File();
+            it = _files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+        }
+        return File(it->second);
+    }
+
+    bool exists(const char* path) const { return _files.count(path) > 0; }
+    bool remove(const char* path) { return _files.erase(path) > 0; }
+
+    bool rename(const char* from, const char* to) {
+        auto it = _files.find(from);
+        if (it == _files.end()) return false;
+        _files[to] = it->second;
+        _files.erase(from);
+        return true;
+    }
+
+    void clearAll() { _files.clear(); }
+
+private:
+    std::map<std::string, File::Data> _files;
+};
+
+inline HostLittleFS LittleFS;
@@ -0,0 +1,220 @@
+// Host tests of the activity scheduler. Time only moves when the test says
+// so, which makes every interleaving below exact.
+//   pio test -e native_activities -v
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "Activity.h"
+
+static const ActivityEvents EVENT_A = 1 << 0;
+static const ActivityEvents EVENT_B = 1 << 1;
+
+// Appends "<tag>@<ms>" for every resume, for comparing whole schedules
+static char trace[512];
+
+static void mark(char tag, uint32_t ms) {
+    size_t len = strlen(trace);
+    snprintf(trace + len, sizeof(trace) - len, "%s%c@%u", len ? " " : "", tag, (unsigned)ms);
+}
+
+class Sleeper : public Activity {
+public:
+    Sleeper(char tag, uint32_t periodMs) : Activity("Sleeper"), _tag(tag), _periodMs(periodMs) {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            mark(_tag, now());
+            ACTIVITY_SLEEP(_periodMs);
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    char _tag;
+    uint32_t _periodMs;
+};
+
+class Periodic : public Activity {
+public:
+    Periodic() : Activity("Periodic"), _nextMs(0) {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        _nextMs = now();
+        for (;;) {
+            mark('P', now());
+            _nextMs += 1000;
+            ACTIVITY_SLEEP_UNTIL(_nextMs);
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    uint32_t _nextMs;
+};
+
+class Waiter : public Activity {
+public:
+    Waiter(char tag, ActivityEvents events, uint32_t timeoutMs)
+        : Activity("Waiter"), lastWoken(0), _tag(tag), _events(events), _timeoutMs(timeoutMs) {}
+
+    ActivityEvents lastWoken;
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        for (;;) {
+            ACTIVITY_WAIT(_events, _timeoutMs);
+            lastWoken = woken();
+            mark(_tag, now());
+        }
+        ACTIVITY_END();
+    }
+
+private:
+    char _tag;
+    ActivityEvents _events;
+    uint32_t _timeoutMs;
+};
+
+// Signals from its body, as an activity handing work to another would
+class Signaller : public Activity {
+public:
+    Signaller(ActivityScheduler& scheduler) : Activity("Signaller"), _scheduler(scheduler) {}
+
+protected:
+    void step() override {
+        ACTIVITY_BEGIN();
+        ACTIVITY_SLEEP(10);
+        mark('S', now());
+        _scheduler.signal(EVENT_A);
+        ACTIVITY_END();
+    }
+
+private:
+    ActivityScheduler& _scheduler;
+};
+
+// Runs passes the way ActivityTask does, jumping straight to each wake-up
+static uint32_t runUntil(ActivityScheduler& scheduler, uint32_t startMs, uint32_t endMs) {
+    uint32_t nowMs = startMs;
+    for (;;) {
+        uint32_t waitMs = scheduler.runReady(nowMs);
+        if (waitMs == Activity::FOREVER || (int32_t)(nowMs + waitMs - endMs) > 0) return nowMs;
+        nowMs += waitMs;
+    }
+}
+
+void setUp() {
+    trace[0] = '\0';
+}
+
+void tearDown() {}
+
+void test_sleepers_interleave_in_order_added() {
+    ActivityScheduler scheduler;
+    Sleeper a('A', 30), b('B', 50);
+    scheduler.add(a);
+    scheduler.add(b);
+    runUntil(scheduler, 0, 100);
+    TEST_ASSERT_EQUAL_STRING("A@0 B@0 A@30 B@50 A@60 A@90 B@100", trace);
+}
+
+void test_sleep_until_keeps_the_period() {
+    ActivityScheduler scheduler;
+    Periodic p;
+    scheduler.add(p);
+    // A late pass doesn't shift the following deadlines
+    TEST_ASSERT_EQUAL_UINT32(1000, scheduler.runReady(0));
+    TEST_ASSERT_EQUAL_UINT32(500, scheduler.runReady(500));
+    TEST_ASSERT_EQUAL_UINT32(985, scheduler.runReady(1015));
+    TEST_ASSERT_EQUAL_UINT32(997, scheduler.runReady(2003));
+    // A missed period is made up right away, like vTaskDelayUntil()
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.runReady(4500));
+    TEST_ASSERT_EQUAL_UINT32(500, scheduler.runReady(4500));
+    TEST_ASSERT_EQUAL_STRING("P@0 P@1015 P@2003 P@4500 P@4500", trace);
+}
+
+void test_event_wakes_only_its_waiter() {
+    ActivityScheduler scheduler;
+    Waiter a('A', EVENT_A, 500), b('B', EVENT_B, 500);
+    scheduler.add(a);
+    scheduler.add(b);
+    scheduler.runReady(0);
+
+    scheduler.signal(EVENT_A);
+    TEST_ASSERT_EQUAL_UINT32(480, scheduler.runReady(20));
+    TEST_ASSERT_EQUAL_UINT32(EVENT_A, a.lastWoken);
+
+    // b times out with nothing to show
+    TEST_ASSERT_EQUAL_UINT32(20, scheduler.runReady(500));
+    TEST_ASSERT_EQUAL_UINT32(0, b.lastWoken);
+    TEST_ASSERT_EQUAL_STRING("A@20 B@500", trace);
+}
+
+void test_wait_forever_needs_an_event() {
+    ActivityScheduler scheduler;
+    Waiter w('W', EVENT_A, Activity::FOREVER);
+    scheduler.add(w);
+    TEST_ASSERT_EQUAL_UINT32(Activity::FOREVER, scheduler.runReady(0));
+    TEST_ASSERT_EQUAL_UINT32(Activity::FOREVER, scheduler.runReady(100000));
+    scheduler.signal(EVENT_A);
+    scheduler.runReady(100001);
+    TEST_ASSERT_EQUAL_STRING("W@100001", trace);
+}
+
+void test_event_without_waiter_is_dropped() {
+    ActivityScheduler scheduler;
+    Sleeper s('S', 100);
+    Waiter w('W', EVENT_A, 1000);
+    scheduler.add(s);
+    scheduler.add(w);
+    scheduler.runReady(0);
+
+    // Nobody waits for EVENT_B, the sleeper isn't woken early
+    scheduler.signal(EVENT_B);
+    TEST_ASSERT_EQUAL_UINT32(100, scheduler.runReady(0));
+    scheduler.runReady(100);
+    TEST_ASSERT_EQUAL_STRING("S@0 S@100", trace);
+}
+
+void test_signal_from_an_activity_runs_next_pass() {
+    ActivityScheduler scheduler;
+    Waiter w('W', EVENT_A, Activity::FOREVER);
+    Signaller s(scheduler);
+    scheduler.add(w);  // Ahead of the signaller, so it can only run a pass later
+    scheduler.add(s);
+    TEST_ASSERT_EQUAL_UINT32(10, scheduler.runReady(0));
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.runReady(10));
+    TEST_ASSERT_EQUAL_UINT32(Activity::FOREVER, scheduler.runReady(10));
+    TEST_ASSERT_EQUAL_STRING("S@10 W@10", trace);
+    TEST_ASSERT_TRUE(s.finished());
+    TEST_ASSERT_EQUAL_UINT32(2, s.runs());
+}
+
+void test_timers_survive_millis_wrap() {
+    ActivityScheduler scheduler;
+    Sleeper s('S', 0x200);
+    scheduler.add(s);
+    TEST_ASSERT_EQUAL_UINT32(0x200, scheduler.runReady(0xFFFFFF00u));
+    TEST_ASSERT_EQUAL_UINT32(0x100, scheduler.runReady(0x00000000u));
+    TEST_ASSERT_EQUAL_UINT32(0x200, scheduler.runReady(0x00000100u));
+    TEST_ASSERT_EQUAL_UINT32(2, s.runs());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_sleepers_interleave_in_order_added);
+    RUN_TEST(test_sleep_until_keeps_the_period);
+    RUN_TEST(test_event_wakes_only_its_waiter);
+    RUN_TEST(test_wait_forever_needs_an_event);
+    RUN_TEST(test_event_without_waiter_is_dropped);
+    RUN_TEST(test_signal_from_an_activity_runs_next_pass);
+    RUN_TEST(test_timers_survive_millis_wrap);
+    printf("{\"activity_bytes\": %u, \"scheduler_bytes\": %u}\n", (unsigned)sizeof(Sleeper),
+           (unsigned)sizeof(ActivityScheduler));
+    return UNITY_END();
+}
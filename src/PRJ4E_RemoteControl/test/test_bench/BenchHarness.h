@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+// Minimal benchmark runner. Each benchmark is repeated until it has run for
+// at least MIN_RUN_US, results are printed as Google Benchmark style JSON so
+// runs can be compared with the usual tooling.
+class BenchRunner {
+public:
+    static constexpr int MAX_RESULTS = 32;
+#ifdef ARDUINO
+    static constexpr uint32_t MIN_RUN_US = 20000;
+#else
+    static constexpr uint32_t MIN_RUN_US = 200000;
+#endif
+
+    template <typename Fn>
+    void run(const char* name, Fn fn) {
+        uint32_t iterations = 1;
+        for (;;) {
+            uint64_t startUs = nowUs();
+            uint32_t startCycles = cycles();
+            for (uint32_t i = 0; i < iterations; ++i) fn();
+            uint32_t elapsedCycles = cycles() - startCycles;
+            uint64_t elapsedUs = nowUs() - startUs;
+
+            if (elapsedUs >= MIN_RUN_US || iterations >= (1u << 30)) {
+                record(name, iterations, elapsedUs, elapsedCycles);
+                return;
+            }
+            iterations *= 2;
+        }
+    }
+
+    void printJson() const {
+        printf("{\n  \"context\": {\"target\": \"%s\"},\n  \"benchmarks\": [\n", targetName());
+        for (int i = 0; i < _count; ++i) {
+            const Result& r = _results[i];
+            printf("    {\"name\": \"%s\", \"iterations\": %lu, \"real_time\": %.1f, \"time_unit\": \"ns\"",
+                   r.name, (unsigned long)r.iterations, r.nsPerOp);
+#ifdef ARDUINO
+            printf(", \"cycles_per_iteration\": %.1f", r.cyclesPerOp);
+#endif
+            printf("}%s\n", (i + 1 < _count) ? "," : "");
+        }
+        printf("  ]\n}\n");
+    }
+
+private:
+    struct Result {
+        const char* name;
+        uint32_t iterations;
+        double nsPerOp;
+        double cyclesPerOp;
+    };
+
+#ifdef ARDUINO
+    static const char* targetName() { return "esp32"; }
+    static uint64_t nowUs() { return micros(); }
+    static uint32_t cycles() { return ESP.getCycleCount(); }
+#else
+    static const char* targetName() { return "host"; }
+    static uint64_t nowUs() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+    static uint32_t cycles() { return 0; }
+#endif
+
+    void record(const char* name, uint32_t iterations, uint64_t elapsedUs, uint32_t elapsedCycles) {
+        if (_count >= MAX_RESULTS) return;
+        Result& r = _results[_count++];
+        r.name = name;
+        r.iterations = iterations;
+        r.nsPerOp = elapsedUs * 1000.0 / iterations;
+        r.cyclesPerOp = (double)elapsedCycles / iterations;
+    }
+
+    Result _results[MAX_RESULTS];
+    int _count = 0;
+};
@@ -0,0 +1,212 @@
+// Micro-benchmarks for the control, codec and rendering hot paths.
+//   Host:   pio test -e native_bench -v
+//   Target: pio test -e ttgo-lora-bench -v   (adds CPU cycles per iteration)
+#include <unity.h>
+#include <U8g2lib.h>
+#include "BenchHarness.h"
+#include "ValveController.h"
+#include "DisplayManager.h"
+#include "LoRaProtocol.h"
+#include "HistoryFormat.h"
+#ifdef ARDUINO
+#include "FrameAuth.h"
+#endif
+
+// SSD1306 frame buffer without a bus behind it, so only drawing and tile
+// preparation are measured
+class OffscreenU8G2 : public U8G2 {
+public:
+    OffscreenU8G2() {
+        u8g2_Setup_ssd1306_128x64_noname_f(&u8g2, U8G2_R0, u8x8_byte_empty, u8x8_dummy_cb);
+    }
+};
+
+static BenchRunner runner;
+static volatile int sink;
+
+void setUp() {}
+void tearDown() {}
+
+void bench_valve_controller() {
+    ValveController controller;
+    for (int i = 0; i < 5; ++i) controller.recordTemperature(20.0f + i * 0.1f);
+
+    float temp = 20.0f;
+    runner.run("ValveController/recordTemperature", [&]() {
+        temp += 0.01f;
+        if (temp > 22.0f) temp = 20.0f;
+        controller.recordTemperature(temp);
+    });
+    runner.run("ValveController/update", [&]() {
+        controller.update(20.4f, 21.0f);
+        sink = controller.getValvePosition();
+        if (sink >= 100) controller.setValvePosition(0);
+    });
+    TEST_ASSERT_TRUE(controller.getValvePosition() >= 0);
+}
+
+void bench_remote_codec() {
+    char buffer[48];
+    runner.run("Remote/formatValveCommand", [&]() {
+        sink = formatValveCommand(buffer, sizeof(buffer), 42.5f);
+    });
+    runner.run("Remote/formatControlReport", [&]() {
+        sink = formatControlReport(buffer, sizeof(buffer), 21.5f, 20.31f, 45.12f);
+    });
+
+    ActuatorStatus status;
+    runner.run("Remote/parseActuatorStatus", [&]() {
+        sink = ActuatorStatus::parse("STAT:44,45,0,612,-87,9.5,1240,3512,0", status);
+    });
+    TEST_ASSERT_EQUAL(45, status.targetPercent);
+}
+
+void bench_motor_codec() {
+    LoRaCommand command;
+    runner.run("Motor/parseValve", [&]() {
+        sink = LoRaCommand::parse("VALVE:42.50", command);
+    });
+    runner.run("Motor/parseCtrl", [&]() {
+        sink = LoRaCommand::parse("CTRL:21.5,20.31,45.12", command);
+    });
+    runner.run("Motor/parseCurve", [&]() {
+        sink = LoRaCommand::parse("CURVE:0,1,3,5,8,11,15,19,24,30,100", command);
+    });
+    TEST_ASSERT_EQUAL(LoRaCommand::CURVE, command.type);
+
+    StatusReport report;
+    report.actualPercent = 44;
+    report.targetPercent = 45;
+    report.peakCurrent_mA = 612;
+    report.rssi = -87;
+    report.snr = 9.5f;
+    char buffer[48];
+    runner.run("Motor/formatStatus", [&]() {
+        sink = report.format(buffer, sizeof(buffer));
+    });
+}
+
+void bench_display() {
+    OffscreenU8G2 u8g2;
+    DisplayManager display(u8g2);
+    display.init();
+    display.updateLinkStatus(-90, false);
+
+    float temp = 20.0f;
+    runner.run("DisplayManager/updateTemperature", [&]() {
+        temp = (temp > 25.0f) ? 20.0f : temp + 0.1f;
+        display.updateTemperature(temp);
+    });
+
+    display.goToMenuScreen();
+    runner.run("DisplayManager/drawMenu", [&]() {
+        display.moveSelection(1);
+    });
+
+    display.goToSetTempScreen();
+    runner.run("DisplayManager/updateSetTempScreen", [&]() {
+        display.updateSetTempScreen(21.3f);
+    });
+
+    static HistoryFormat::Sample samples[DisplayManager::GRAPH_POINTS];
+    for (int i = 0; i < DisplayManager::GRAPH_POINTS; ++i) {
+        samples[i].temp = (int16_t)(205 + (i * 7) % 11);
+        samples[i].target = (i < 60) ? 210 : 180;
+        samples[i].valve = (uint8_t)(i % 50);
+        samples[i].gap = (i == 40);
+    }
+    runner.run("DisplayManager/drawGraph", [&]() {
+        display.goToGraphScreen(samples, DisplayManager::GRAPH_POINTS, "Last 96 min");
+    });
+
+    runner.run("U8G2/sendBuffer", [&]() {
+        u8g2.sendBuffer();
+    });
+}
+
+void bench_history_format() {
+    HistoryFormat::Encoder encoder;
+    HistoryFormat::Sample sample = {205, 210, 30, false};
+    uint8_t record[HistoryFormat::MAX_RECORD];
+    int i = 0;
+    runner.run("HistoryFormat/encode", [&]() {
+        sample.temp = (int16_t)(205 + (++i % 5 == 0));
+        sink = encoder.add(sample, record);
+    });
+
+    // Steady noisy room: one byte per sample, folded runs when it settles
+    static uint8_t stream[512];
+    size_t len = 0;
+    encoder.reset(true);
+    for (int k = 0; k < 400 && len + HistoryFormat::MAX_RECORD <= sizeof(stream); ++k) {
+        sample.temp = (int16_t)(205 + (k * 7) % 3 - 1);
+        len += encoder.add(sample, stream + len);
+    }
+    len += encoder.flush(stream + len);
+
+    int decoded = 0;
+    runner.run("HistoryFormat/decode", [&]() {
+        HistoryFormat::Sample s = {};
+        int repeat;
+        size_t used;
+        decoded = 0;
+        for (size_t pos = 0; (used = HistoryFormat::decodeRecord(stream + pos, stream + len, s, repeat)) > 0; pos += used) {
+            decoded += 1 + repeat;
+        }
+        sink = s.temp;
+    });
+    TEST_ASSERT_EQUAL(400, decoded);
+}
+
+#ifdef ARDUINO
+// Sealing and checking go through the hardware AES engine, so only on target
+void bench_frame_auth() {
+    static const uint8_t key[FrameAuth::KEY_BYTES] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                                      0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    FrameAuth remote('R', 'M');
+    FrameAuth motor('M', 'R');
+    TEST_ASSERT_TRUE(remote.setKey(key));
+    TEST_ASSERT_TRUE(motor.setKey(key));
+
+    char frame[48 + FrameAuth::OVERHEAD];
+    runner.run("FrameAuth/seal", [&]() {
+        strcpy(frame, "CTRL:21.5,20.31,45.12");
+        sink = remote.seal(frame, sizeof(frame));
+    });
+    runner.run("FrameAuth/sealAndOpen", [&]() {
+        strcpy(frame, "STAT:44,45,0,612,-87,9.5");
+        motor.seal(frame, sizeof(frame));
+        sink = remote.open(frame);
+    });
+    TEST_ASSERT_EQUAL_STRING("STAT:44,45,0,612,-87,9.5", frame);
+    TEST_ASSERT_EQUAL(0, remote.rejectedFrames());
+}
+#endif
+
+static void runBenchmarks() {
+    UNITY_BEGIN();
+    RUN_TEST(bench_valve_controller);
+    RUN_TEST(bench_remote_codec);
+    RUN_TEST(bench_motor_codec);
+    RUN_TEST(bench_display);
+    RUN_TEST(bench_history_format);
+#ifdef ARDUINO
+    RUN_TEST(bench_frame_auth);
+#endif
+    runner.printJson();
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+    delay(2000);  // Give the test runner time to open the port
+    runBenchmarks();
+}
+
+void loop() {}
+#else
+int main() {
+    runBenchmarks();
+    return 0;
+}
+#endif
@@ -0,0 +1,129 @@
+// Host simulation of a heated room with OpenWindowDetector and
+// ValveController wired up as in the remote's sensor and valve activities.
+// Measures how long an opened window goes unnoticed and when control resumes.
+//   pio test -e native_window -v
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "OpenWindowDetector.h"
+#include "ValveController.h"
+
+static const uint32_t SAMPLE_PERIOD_MS = 1000;    // Comfort profile
+static const uint32_t CONTROL_PERIOD_MS = 10000;
+static const float TARGET_C = 21.0f;
+
+// Single air node: heat from the radiator in proportion to the valve,
+// losses through the walls and, while open, through the window [1/s]
+static const float HEAT_RATE = 0.003f;              // C/s at 100 % valve
+static const float WALL_LOSS = 1.0f / (3 * 3600);
+static const float WINDOW_WIDE = 1.0f / 600;
+static const float WINDOW_TILTED = 1.0f / 1800;
+static const float OUTSIDE_C = 5.0f;
+
+struct Simulation {
+    float room = TARGET_C;
+    float windowLoss = 0.0f;
+    uint32_t nowMs = 0;
+    uint32_t seed = 12345;
+    ValveController controller;
+    OpenWindowDetector detector;
+
+    // DS18B20 at 12 bit plus a little noise
+    float sensor() {
+        seed = seed * 1103515245u + 12345u;
+        float noise = ((int)((seed >> 16) % 100) - 50) / 1000.0f;
+        return roundf((room + noise) * 16.0f) / 16.0f;
+    }
+
+    void stepSecond() {
+        float loss = (room - OUTSIDE_C) * (WALL_LOSS + windowLoss);
+        room += controller.getValvePosition() / 100.0f * HEAT_RATE - loss;
+        nowMs += SAMPLE_PERIOD_MS;
+
+        bool wasOpen = detector.isOpen();
+        bool open = detector.addSample(nowMs, sensor());
+        // The sensor activity wakes the valve activity, so the valve shuts right away
+        if (open && !wasOpen) controller.setValvePosition(0);
+
+        if (nowMs % CONTROL_PERIOD_MS == 0) {
+            float temp = sensor();
+            controller.recordTemperature(temp);
+            if (open) controller.setValvePosition(0);
+            else controller.update(temp, TARGET_C);
+        }
+    }
+
+    // Seconds until the detector reaches the given state, -1 on timeout
+    long runUntil(bool open, long maxSeconds) {
+        for (long s = 1; s <= maxSeconds; ++s) {
+            stepSecond();
+            if (detector.isOpen() == open) return s;
+        }
+        return -1;
+    }
+
+    void run(long seconds) {
+        for (long s = 0; s < seconds; ++s) stepSecond();
+    }
+};
+
+static long wideReactionS = -1, tiltedReactionS = -1, recoveryS = -1;
+
+void setUp() {}
+void tearDown() {}
+
+void test_no_detection_during_normal_heating() {
+    Simulation sim;
+    sim.room = 17.0f;  // Morning warm-up, then a day of regulation
+    sim.run(24 * 3600);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.detector.detections());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, TARGET_C, sim.room);
+}
+
+void test_reaction_to_wide_open_window() {
+    Simulation sim;
+    sim.run(2 * 3600);
+    sim.windowLoss = WINDOW_WIDE;
+    wideReactionS = sim.runUntil(true, 600);
+    TEST_ASSERT_TRUE(wideReactionS > 0);
+    TEST_ASSERT_TRUE(wideReactionS <= 30);
+    TEST_ASSERT_EQUAL(0, sim.controller.getValvePosition());
+}
+
+void test_reaction_to_tilted_window() {
+    Simulation sim;
+    sim.run(2 * 3600);
+    sim.windowLoss = WINDOW_TILTED;
+    tiltedReactionS = sim.runUntil(true, 600);
+    TEST_ASSERT_TRUE(tiltedReactionS > 0);
+    TEST_ASSERT_TRUE(tiltedReactionS <= 60);
+}
+
+void test_recovers_after_window_closes() {
+    Simulation sim;
+    sim.run(2 * 3600);
+    sim.windowLoss = WINDOW_WIDE;
+    TEST_ASSERT_TRUE(sim.runUntil(true, 600) > 0);
+    sim.run(10 * 60);
+    TEST_ASSERT_TRUE(sim.detector.isOpen());  // Still held while the room cools
+
+    sim.windowLoss = 0.0f;
+    recoveryS = sim.runUntil(false, OpenWindowDetector::MAX_HOLD_MS / 1000);
+    TEST_ASSERT_TRUE(recoveryS > 0);
+
+    // Control resumes and brings the room back without detecting again
+    sim.run(3 * 3600);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.detector.detections());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, TARGET_C, sim.room);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_detection_during_normal_heating);
+    RUN_TEST(test_reaction_to_wide_open_window);
+    RUN_TEST(test_reaction_to_tilted_window);
+    RUN_TEST(test_recovers_after_window_closes);
+    printf("{\"reaction_wide_s\": %ld, \"reaction_tilted_s\": %ld, \"recovery_after_close_s\": %ld}\n",
+           wideReactionS, tiltedReactionS, recoveryS);
+    return UNITY_END();
+}
@@ -0,0 +1,371 @@
+// Replays a recorded controller trace through ValveController and checks
+// that every update makes the same decision as on the device.
+//   TRACE_FILE=room.log pio test -e native_replay -v
+// TRACE_FILE is either the binary trace or a serial log containing the
+// "TRACE:<hex>" lines printed by the remote's TRACE command.
+#include <unity.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <LittleFS.h>
+#include "TraceFormat.h"
+#include "TraceRecorder.h"
+#include "ValveController.h"
+
+static const int MAX_REPORTED_MISMATCHES = 10;
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Serial log: decodes the hex payload of every TRACE: line
+static void decodeTraceLines(const std::string& content, std::vector<uint8_t>& trace) {
+    size_t pos = 0;
+    while ((pos = content.find("TRACE:", pos)) != std::string::npos) {
+        pos += 6;
+        while (pos + 1 < content.size()) {
+            int hi = hexValue(content[pos]);
+            int lo = hexValue(content[pos + 1]);
+            if (hi < 0 || lo < 0) break;
+            trace.push_back((uint8_t)(hi << 4 | lo));
+            pos += 2;
+        }
+    }
+}
+
+static bool loadTrace(const char* path, std::vector<uint8_t>& trace) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    std::string content;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) content.append(buf, n);
+    fclose(file);
+
+    if (content.find("TRACE:") == std::string::npos) trace.assign(content.begin(), content.end());
+    else decodeTraceLines(content, trace);
+    return true;
+}
+
+struct ReplayResult {
+    long sessions = 0;
+    long records = 0;
+    long mismatches = 0;
+    long skippedBytes = 0;  // Sessions of a version this replay doesn't know
+    double simulatedSeconds = 0.0;
+    bool corrupt = false;
+};
+
+// Offset of the next session header of a known version at or after pos
+static size_t findSession(const std::vector<uint8_t>& trace, size_t pos) {
+    for (; pos + TraceFormat::SESSION_SIZE <= trace.size(); ++pos) {
+        if (TraceFormat::isHeader(trace[pos]) && TraceFormat::isKnownVersion(trace[pos + 1])) return pos;
+    }
+    return trace.size();
+}
+
+static ReplayResult replay(const std::vector<uint8_t>& trace) {
+    ReplayResult result;
+    ValveController controller;
+    uint8_t version = 0;  // Of the current session, entries before the first one are corrupt
+
+    size_t pos = 0;
+    while (pos < trace.size()) {
+        uint8_t tag = trace[pos];
+        if (TraceFormat::isHeader(tag) && pos + TraceFormat::SESSION_SIZE <= trace.size()) {
+            version = trace[pos + 1];
+            if (!TraceFormat::isKnownVersion(version)) {
+                // Entry sizes are unknown, so the rest can only be skipped up to a session we can read
+                size_t next = findSession(trace, pos + 1);
+                printf("Skipping %u bytes of trace version %u\n", (unsigned)(next - pos), version);
+                result.skippedBytes += next - pos;
+                pos = next;
+                continue;
+            }
+            if (tag == TraceFormat::TAG_SESSION) {
+                controller = ValveController();  // Device rebooted
+                result.sessions++;
+            }
+            pos += TraceFormat::SESSION_SIZE;
+        } else if (tag == TraceFormat::TAG_PROFILE && version >= TraceFormat::PROFILE_SINCE_VERSION &&
+                   pos + TraceFormat::PROFILE_SIZE <= trace.size()) {
+            controller.setStepSize(trace[pos + 1]);  // Mode changed on the device
+            pos += TraceFormat::PROFILE_SIZE;
+        } else if (tag == TraceFormat::TAG_RECORD && version != 0 &&
+                   pos + TraceFormat::recordSize(version) <= trace.size()) {
+            TraceFormat::Record r;
+            TraceFormat::decodeRecord(&trace[pos], version, r);
+            pos += TraceFormat::recordSize(version);
+
+            // Same sequence as ValveControlActivity, starting from the recorded position
+            if (r.flags & TraceFormat::FLAG_STALL) controller.applyActuatorStatus(r.valveBefore, true);
+            controller.setValvePosition(r.valveBefore);
+            controller.recordTemperature(r.temp);
+            if (r.flags & TraceFormat::FLAG_WINDOW_OPEN) controller.setValvePosition(0);
+            else controller.update(r.temp, r.target, r.supply);
+
+            int decided = controller.getValvePosition();
+            if (decided != r.valveAfter) {
+                if (result.mismatches < MAX_REPORTED_MISMATCHES) {
+                    printf("record %ld: temp %.2f target %.2f valve %d -> recorded %d, replayed %d\n",
+                           result.records, r.temp, r.target, r.valveBefore, r.valveAfter, decided);
+                }
+                result.mismatches++;
+            }
+            result.simulatedSeconds += r.dtDeciSeconds / 10.0;
+            result.records++;
+        } else {
+            result.corrupt = true;
+            break;
+        }
+    }
+    return result;
+}
+
+// Device side of a synthetic trace: a room warming up and cooling down
+// again around the target, run through a ValveController like the valve
+// activity does, with the entries written in the given version's layout
+struct TraceWriter {
+    std::vector<uint8_t> trace;
+    ValveController device;
+    uint8_t version = TraceFormat::VERSION;
+    float temp = 19.0f;
+    int cycle = 0;
+
+    void session(uint8_t sessionVersion, uint32_t periodMs = 10000) {
+        version = sessionVersion;
+        device = ValveController();
+        uint8_t entry[TraceFormat::SESSION_SIZE];
+        TraceFormat::encodeSession(entry, periodMs);
+        entry[1] = version;
+        trace.insert(trace.end(), entry, entry + sizeof(entry));
+    }
+
+    void profile(uint8_t valveStep, uint32_t periodMs) {
+        device.setStepSize(valveStep);
+        uint8_t entry[TraceFormat::PROFILE_SIZE];
+        TraceFormat::encodeProfile(entry, valveStep, periodMs);
+        trace.insert(trace.end(), entry, entry + sizeof(entry));
+    }
+
+    // The next control cycle of the device
+    TraceFormat::Record next(float target) {
+        temp += (cycle++ % 80 < 40) ? 0.07f : -0.07f;
+        TraceFormat::Record r;
+        r.dtDeciSeconds = 100;
+        r.temp = temp;
+        r.target = target;
+        r.supply = version == 1 ? NAN : 45.0f;
+        r.valveBefore = device.getValvePosition();
+        device.recordTemperature(temp);
+        device.update(temp, target, r.supply);
+        r.valveAfter = device.getValvePosition();
+        r.flags = 0;
+        return r;
+    }
+
+    void records(int count, float target = 21.0f) {
+        for (int i = 0; i < count; ++i) {
+            TraceFormat::Record r = next(target);
+            uint8_t entry[TraceFormat::RECORD_SIZE];
+            TraceFormat::encodeRecord(entry, r);
+            if (version == 1) {
+                // No supply temperature, valves and flags follow the target
+                memmove(entry + 11, entry + 15, 3);
+            }
+            trace.insert(trace.end(), entry, entry + TraceFormat::recordSize(version));
+        }
+    }
+};
+
+// Collects what TraceRecorder::dump() prints
+class DumpCapture : public Print {
+public:
+    std::string text;
+    size_t write(const uint8_t* data, size_t len) override {
+        text.append((const char*)data, len);
+        return len;
+    }
+};
+
+// Runs the writer's device through a TraceRecorder on the in-memory LittleFS
+static void record(TraceRecorder& recorder, TraceWriter& writer, int count) {
+    for (int i = 0; i < count; ++i) {
+        TraceFormat::Record r = writer.next(21.0f);
+        recorder.record(r.temp, r.target, r.supply, r.valveBefore, r.valveAfter, false, false);
+    }
+}
+
+static std::vector<uint8_t> dumpTrace(TraceRecorder& recorder) {
+    DumpCapture capture;
+    recorder.dump(capture);
+    std::vector<uint8_t> trace;
+    decodeTraceLines(capture.text, trace);
+    return trace;
+}
+
+void setUp() {
+    LittleFS.clearAll();
+}
+
+void tearDown() {}
+
+void test_replay_matches_recorded_decisions() {
+    const char* path = getenv("TRACE_FILE");
+    if (!path) TEST_IGNORE_MESSAGE("Set TRACE_FILE to a recorded trace");
+
+    std::vector<uint8_t> trace;
+    TEST_ASSERT_TRUE_MESSAGE(loadTrace(path, trace), "Cannot read TRACE_FILE");
+
+    auto start = std::chrono::steady_clock::now();
+    ReplayResult result = replay(trace);
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("{\"sessions\": %ld, \"records\": %ld, \"mismatches\": %ld, \"skipped_bytes\": %ld, "
+           "\"simulated_s\": %.0f, \"wall_s\": %.6f, \"speedup\": %.0f}\n",
+           result.sessions, result.records, result.mismatches, result.skippedBytes, result.simulatedSeconds,
+           wallSeconds, wallSeconds > 0.0 ? result.simulatedSeconds / wallSeconds : 0.0);
+
+    TEST_ASSERT_TRUE_MESSAGE(!result.corrupt, "Corrupt trace");
+    TEST_ASSERT_EQUAL_MESSAGE(0, result.mismatches, "Controller decisions differ from the recorded trace");
+}
+
+// A file written across firmware updates before TraceRecorder rotated on
+// a version change: each session is decoded in its own layout
+void test_replay_reads_each_session_in_its_version() {
+    TraceWriter writer;
+    writer.session(1);
+    writer.records(60);
+    writer.session(2);
+    writer.records(60);
+    writer.session(TraceFormat::VERSION);
+    writer.records(60);
+
+    ReplayResult result = replay(writer.trace);
+    TEST_ASSERT_TRUE(!result.corrupt);
+    TEST_ASSERT_EQUAL(3, result.sessions);
+    TEST_ASSERT_EQUAL(180, result.records);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+}
+
+void test_replay_skips_unknown_versions() {
+    TraceWriter writer;
+    writer.session(TraceFormat::VERSION + 1);
+    writer.records(20);
+    writer.session(TraceFormat::VERSION);
+    writer.records(30);
+
+    ReplayResult result = replay(writer.trace);
+    TEST_ASSERT_TRUE(!result.corrupt);
+    TEST_ASSERT_EQUAL(1, result.sessions);
+    TEST_ASSERT_EQUAL(30, result.records);
+    TEST_ASSERT_EQUAL(TraceFormat::SESSION_SIZE + 20 * TraceFormat::RECORD_SIZE, result.skippedBytes);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+}
+
+// A mode change mid-session: the replay has to switch step size where the
+// device did, or the decisions after the 'P' entry come out different
+void test_replay_applies_profile_changes() {
+    TraceWriter writer;
+    writer.session(TraceFormat::VERSION);
+    writer.records(80);
+    size_t profileAt = writer.trace.size();
+    writer.profile(15, 5000);
+    writer.records(160);
+
+    ReplayResult result = replay(writer.trace);
+    TEST_ASSERT_TRUE(!result.corrupt);
+    TEST_ASSERT_EQUAL(240, result.records);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+
+    // Without the entry the same records no longer replay
+    std::vector<uint8_t> withoutProfile(writer.trace);
+    withoutProfile.erase(withoutProfile.begin() + profileAt,
+                         withoutProfile.begin() + profileAt + TraceFormat::PROFILE_SIZE);
+    TEST_ASSERT_TRUE(replay(withoutProfile).mismatches > 0);
+}
+
+void test_replay_rejects_profile_in_older_session() {
+    TraceWriter writer;
+    writer.session(2);
+    writer.records(10);
+    writer.profile(15, 5000);
+    writer.records(10);
+
+    ReplayResult result = replay(writer.trace);
+    TEST_ASSERT_TRUE(result.corrupt);
+    TEST_ASSERT_EQUAL(10, result.records);
+}
+
+// Rotation starts trace.bin afresh; it has to open with a header and the
+// current profile, or the dump no longer replays and the next boot takes the
+// file for one of another version and deletes trace.old
+void test_recorder_rotation_replays() {
+    TraceWriter writer;
+    TraceRecorder recorder;
+    TEST_ASSERT_TRUE(recorder.begin(10000));
+    writer.device.setStepSize(15);
+    recorder.recordProfile(15, 5000);
+
+    int written = 0;
+    for (; !LittleFS.exists("/trace.old"); written += 100) record(recorder, writer, 100);
+    record(recorder, writer, 200);
+    written += 200;
+
+    ReplayResult result = replay(dumpTrace(recorder));
+    TEST_ASSERT_TRUE(!result.corrupt);
+    TEST_ASSERT_EQUAL(1, result.sessions);
+    TEST_ASSERT_EQUAL(written, result.records);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+
+    // Next boot keeps both files
+    size_t oldSize = LittleFS.open("/trace.old").size();
+    TraceRecorder rebooted;
+    TEST_ASSERT_TRUE(rebooted.begin(5000));
+    TEST_ASSERT_EQUAL(oldSize, LittleFS.open("/trace.old").size());
+    result = replay(dumpTrace(rebooted));
+    TEST_ASSERT_TRUE(!result.corrupt);
+    TEST_ASSERT_EQUAL(2, result.sessions);
+    TEST_ASSERT_EQUAL(written, result.records);
+}
+
+void test_recorder_clear_replays() {
+    TraceWriter writer;
+    TraceRecorder recorder;
+    TEST_ASSERT_TRUE(recorder.begin(10000));
+    writer.device.setStepSize(15);
+    recorder.recordProfile(15, 5000);
+    record(recorder, writer, 100);
+    recorder.clear();
+    record(recorder, writer, 160);
+
+    ReplayResult result = replay(dumpTrace(recorder));
+    TEST_ASSERT_TRUE(!result.corrupt);
+    TEST_ASSERT_EQUAL(160, result.records);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+
+    // Not moved aside as stale on the next boot
+    TraceRecorder rebooted;
+    TEST_ASSERT_TRUE(rebooted.begin(5000));
+    TEST_ASSERT_FALSE(LittleFS.exists("/trace.old"));
+    TEST_ASSERT_EQUAL(160, replay(dumpTrace(rebooted)).records);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_matches_recorded_decisions);
+    RUN_TEST(test_replay_reads_each_session_in_its_version);
+    RUN_TEST(test_replay_skips_unknown_versions);
+    RUN_TEST(test_replay_applies_profile_changes);
+    RUN_TEST(test_replay_rejects_profile_in_older_session);
+    RUN_TEST(test_recorder_rotation_replays);
+    RUN_TEST(test_recorder_clear_replays);
+    return UNITY_END();
+}